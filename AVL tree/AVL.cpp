@@ -2,14 +2,71 @@
 
 AVL::AVL() : root(nullptr) {}
 
-AVL::AVL(int* arr, size_t size)
+// Nodes come from pool instead of new; a tree that holds the only reference
+// to its pool frees all nodes at once in clear() and the destructor.
+AVL::AVL(std::shared_ptr<node_pool> pool) : root(nullptr), pool(std::move(pool)) {}
+
+AVL::AVL(int* arr, size_t size) : root(nullptr)
 {
-	for (size_t index = 0; index < size; index++)
+	build(arr, size);
+}
+
+// Sorted input is used as is, anything else is sorted once (in parallel);
+// the tree is then built top-down from the middle of each range in O(n),
+// with no comparisons and no rotations.
+void AVL::build(const int* keys, size_t size)
+{
+	release();
+
+	std::vector<int> sorted;
+	if (!std::is_sorted(keys, keys + size))
 	{
-		insert(arr[index]);
+		sorted.assign(keys, keys + size);
+		parallel_sort(sorted.begin(), sorted.end());
+		keys = sorted.data();
+	}
+
+	struct range
+	{
+		size_t first, last;
+		node* parent;
+		node** link;
+	};
+
+	std::stack<range> stack;
+	stack.push({ 0, size, nullptr, &root });
+
+	while (!stack.empty())
+	{
+		range current = stack.top();
+		stack.pop();
+
+		if (current.first == current.last) continue;
+
+		// when the split is uneven the left half gets the extra key
+		size_t middle = current.first + (current.last - current.first) / 2;
+		node* new_node = create_node(keys[middle], current.parent);
+		new_node->height = balanced_height(current.last - current.first);
+		new_node->size = current.last - current.first;
+		*current.link = new_node;
+
+		stack.push({ middle + 1, current.last, new_node, &new_node->right });
+		stack.push({ current.first, middle, new_node, &new_node->left });
 	}
 }
 
+// height of the tree build() makes out of size keys: floor(log2(size))
+int AVL::balanced_height(size_t size)
+{
+	int height = -1;
+	while (size)
+	{
+		size >>= 1;
+		++height;
+	}
+	return height;
+}
+
 AVL::node* AVL::search(int key)
 {
 	node* current_node = root;
@@ -31,37 +88,26 @@ AVL::node* AVL::search(int key)
 
 AVL::~AVL()
 {
-	if (root)
-	{
-		std::queue<node*> q;
-		q.push(root);
-
-		while (!q.empty())
-		{
-			if (q.front()->right)
-			{
-				q.push(q.front()->right);
-			}
-			if (q.front()->left)
-			{
-				q.push(q.front()->left);
-			}
-			delete q.front();
-			q.pop();
-		}
-		root = nullptr;
-	}
+	release();
 }
 
 AVL::AVL(const AVL& other)
 {
+	// like a copied container, the copy gets a pool of its own
+	if (other.pool)
+	{
+		pool = std::make_shared<node_pool>();
+	}
 	init(other);
 }
 
 AVL& AVL::operator=(const AVL& other)
 {
-	if (root) this->~AVL();
-	init(other);
+	if (this != &other)
+	{
+		release();
+		init(other);
+	}
 
 	return *this;
 }
@@ -70,7 +116,7 @@ void AVL::insert(int key)
 {
 	if (root == nullptr)
 	{
-		root = new node(key);
+		root = create_node(key);
 	}
 	else
 	{
@@ -93,15 +139,16 @@ void AVL::insert(int key)
 
 		if (key < prev->key)
 		{
-			prev->left = new node(key, prev);
+			prev->left = create_node(key, prev);
 			current_node = prev->left;
 		}
 		else
 		{
-			prev->right = new node(key, prev);
+			prev->right = create_node(key, prev);
 			current_node = prev->right;
 		}
 
+		update_sizes(prev);
 
 		while (current_node != root)
 		{
@@ -173,7 +220,8 @@ void AVL::remove(node* this_node)
 
 		if (succ != this_node->right)
 		{
-			//rebalance_from = succ->parent;
+			// the subtree that actually shrank is the one succ was taken out of
+			rebalance_from = succ->parent;
 			succ->parent->left = succ->right;
 			if (succ->right)
 				succ->right->parent = succ->parent;
@@ -186,10 +234,14 @@ void AVL::remove(node* this_node)
 		this_node->left->parent = succ;
 
 		succ->parent = this_node->parent;
+		// succ takes over the place, and until the rebalancing below reaches
+		// it, the height that goes with it
+		succ->height = this_node->height;
 		son = succ;
 	}
 
-	delete this_node;
+	destroy_node(this_node);
+	update_sizes(rebalance_from);
 
 	this_node = rebalance_from;
 	while (this_node != nullptr)
@@ -246,7 +298,7 @@ void AVL::remove(int key)
 
 void AVL::clear()
 {
-	this->~AVL();
+	release();
 }
 
 void AVL::print_tree()
@@ -309,7 +361,9 @@ void AVL::init(const AVL& other)
 {
 	if (other.root)
 	{
-		root = new node(other.root->key);
+		root = create_node(other.root->key);
+		root->height = other.root->height;
+		root->size = other.root->size;
 
 		std::stack < std::pair<node*, node*>> stack;
 		stack.push({ root,other.root });
@@ -321,12 +375,16 @@ void AVL::init(const AVL& other)
 
 			if (pair.second->right)
 			{
-				pair.first->right = new node(pair.second->right->key, pair.first);
+				pair.first->right = create_node(pair.second->right->key, pair.first);
+				pair.first->right->height = pair.second->right->height;
+				pair.first->right->size = pair.second->right->size;
 				stack.push({ pair.first->right ,pair.second->right });
 			}
 			if (pair.second->left)
 			{
-				pair.first->left = new node(pair.second->left->key, pair.first);
+				pair.first->left = create_node(pair.second->left->key, pair.first);
+				pair.first->left->height = pair.second->left->height;
+				pair.first->left->size = pair.second->left->size;
 				stack.push({ pair.first->left,pair.second->left });
 			}
 
@@ -335,6 +393,56 @@ void AVL::init(const AVL& other)
 	else root = nullptr;
 }
 
+void AVL::release()
+{
+	// nodes hold only ints, so an unshared pool can simply be dropped
+	if (root && pool && pool.use_count() == 1)
+	{
+		pool->release();
+	}
+	else if (root)
+	{
+		std::queue<node*> q;
+		q.push(root);
+
+		while (!q.empty())
+		{
+			if (q.front()->right)
+			{
+				q.push(q.front()->right);
+			}
+			if (q.front()->left)
+			{
+				q.push(q.front()->left);
+			}
+			destroy_node(q.front());
+			q.pop();
+		}
+	}
+	root = nullptr;
+}
+
+AVL::node* AVL::create_node(int key, node* parent)
+{
+	if (pool)
+	{
+		return new (pool->allocate(sizeof(node))) node(key, parent);
+	}
+	return new node(key, parent);
+}
+
+void AVL::destroy_node(node* this_node)
+{
+	if (pool)
+	{
+		pool->deallocate(this_node, sizeof(node));
+	}
+	else
+	{
+		delete this_node;
+	}
+}
+
 
 AVL::node* AVL::max(node* root)
 {
@@ -406,6 +514,8 @@ void AVL::rotate_left(node* this_node)
 
 		this_node->recalculate_height();
 		this_node->parent->recalculate_height();
+		this_node->recalculate_size();
+		this_node->parent->recalculate_size();
 	}
 }
 
@@ -442,6 +552,8 @@ void AVL::rotate_right(node* this_node)
 
 		this_node->recalculate_height();
 		this_node->parent->recalculate_height();
+		this_node->recalculate_size();
+		this_node->parent->recalculate_size();
 	}
 }
 
@@ -499,6 +611,437 @@ bool AVL::find(int key)
 	return true;
 }
 
+size_t AVL::size()
+{
+	return root ? root->size : 0;
+}
+
+size_t AVL::rank(int key)
+{
+	return count_below(key, false);
+}
+
+int AVL::select(size_t k)
+{
+	node* current_node = root;
+
+	while (current_node)
+	{
+		size_t left_size = current_node->left ? current_node->left->size : 0;
+
+		if (k < left_size)
+		{
+			current_node = current_node->left;
+		}
+		else if (k == left_size)
+		{
+			return current_node->key;
+		}
+		else
+		{
+			k -= left_size + 1;
+			current_node = current_node->right;
+		}
+	}
+	return INT_MIN;
+}
+
+size_t AVL::count_range(int low, int high)
+{
+	if (high < low)
+	{
+		return 0;
+	}
+	return count_below(high, true) - count_below(low, false);
+}
+
+// keys < key, or <= key when inclusive; equal keys may sit on either side
+// of each other after rotations, so the walk only relies on in-order position
+size_t AVL::count_below(int key, bool inclusive)
+{
+	size_t count = 0;
+	node* current_node = root;
+
+	while (current_node)
+	{
+		if (current_node->key < key || (inclusive && current_node->key == key))
+		{
+			count += (current_node->left ? current_node->left->size : 0) + 1;
+			current_node = current_node->right;
+		}
+		else
+		{
+			current_node = current_node->left;
+		}
+	}
+	return count;
+}
+
+void AVL::update_sizes(node* from)
+{
+	for (; from != nullptr; from = from->parent)
+	{
+		from->recalculate_size();
+	}
+}
+
+
+void AVL::split(int key, AVL& greater)
+{
+	greater.release();
+	greater.pool = pool;
+
+	node* left;
+	node* right;
+	split_nodes(root, key, false, left, right);
+	set_root(left);
+	greater.set_root(right);
+}
+
+void AVL::join(int key, AVL& right)
+{
+	adopt(right);
+	set_root(join_nodes(root, create_node(key), right.root));
+	right.root = nullptr;
+}
+
+void AVL::join(AVL& right)
+{
+	adopt(right);
+	set_root(join_nodes(root, right.root));
+	right.root = nullptr;
+}
+
+void AVL::union_with(AVL& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(union_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	destroy_nodes(dropped);
+}
+
+void AVL::intersect_with(AVL& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(intersect_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	destroy_nodes(dropped);
+}
+
+void AVL::difference_with(AVL& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(difference_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	destroy_nodes(dropped);
+}
+
+
+int AVL::subtree_height(node* subtree)
+{
+	return subtree ? subtree->height : -1;
+}
+
+size_t AVL::subtree_size(node* subtree)
+{
+	return subtree ? subtree->size : 0;
+}
+
+// The helpers below work on detached subtrees: a returned root may still
+// point at a stale parent, which whoever links it in (or set_root) fixes.
+AVL::node* AVL::make_node(node* left, node* middle, node* right)
+{
+	middle->left = left;
+	middle->right = right;
+	if (left) left->parent = middle;
+	if (right) right->parent = middle;
+	middle->recalculate_height();
+	middle->recalculate_size();
+	return middle;
+}
+
+AVL::node* AVL::rotate_left_subtree(node* subtree)
+{
+	node* top = subtree->right;
+	make_node(subtree->left, subtree, top->left);
+	return make_node(subtree, top, top->right);
+}
+
+AVL::node* AVL::rotate_right_subtree(node* subtree)
+{
+	node* top = subtree->left;
+	make_node(top->right, subtree, subtree->right);
+	return make_node(top->left, top, subtree);
+}
+
+// left is more than one level taller than right: walk down its right spine
+// to a subtree of right's height, hang middle there and rebalance on the way back
+AVL::node* AVL::join_right(node* left, node* middle, node* right)
+{
+	node* spine = left->right;
+
+	if (subtree_height(spine) <= subtree_height(right) + 1)
+	{
+		node* joined = make_node(spine, middle, right);
+		if (subtree_height(joined) <= subtree_height(left->left) + 1)
+		{
+			return make_node(left->left, left, joined);
+		}
+		return rotate_left_subtree(make_node(left->left, left, rotate_right_subtree(joined)));
+	}
+
+	node* joined = join_right(spine, middle, right);
+	node* result = make_node(left->left, left, joined);
+	if (subtree_height(joined) <= subtree_height(left->left) + 1)
+	{
+		return result;
+	}
+	return rotate_left_subtree(result);
+}
+
+AVL::node* AVL::join_left(node* left, node* middle, node* right)
+{
+	node* spine = right->left;
+
+	if (subtree_height(spine) <= subtree_height(left) + 1)
+	{
+		node* joined = make_node(left, middle, spine);
+		if (subtree_height(joined) <= subtree_height(right->right) + 1)
+		{
+			return make_node(joined, right, right->right);
+		}
+		return rotate_right_subtree(make_node(rotate_left_subtree(joined), right, right->right));
+	}
+
+	node* joined = join_left(left, middle, spine);
+	node* result = make_node(joined, right, right->right);
+	if (subtree_height(joined) <= subtree_height(right->right) + 1)
+	{
+		return result;
+	}
+	return rotate_right_subtree(result);
+}
+
+// every key in left <= middle->key <= every key in right, O(height difference)
+AVL::node* AVL::join_nodes(node* left, node* middle, node* right)
+{
+	if (subtree_height(left) > subtree_height(right) + 1)
+	{
+		return join_right(left, middle, right);
+	}
+	if (subtree_height(right) > subtree_height(left) + 1)
+	{
+		return join_left(left, middle, right);
+	}
+	return make_node(left, middle, right);
+}
+
+AVL::node* AVL::join_nodes(node* left, node* right)
+{
+	if (!right)
+	{
+		return left;
+	}
+
+	node* first;
+	node* rest;
+	split_first(right, first, rest);
+	return join_nodes(left, first, rest);
+}
+
+// keys < key (<= key when inclusive) go to left, the others to right
+void AVL::split_nodes(node* tree, int key, bool inclusive, node*& left, node*& right)
+{
+	if (!tree)
+	{
+		left = right = nullptr;
+		return;
+	}
+
+	node* tree_left = tree->left;
+	node* tree_right = tree->right;
+
+	if (tree->key < key || (inclusive && tree->key == key))
+	{
+		node* lower;
+		split_nodes(tree_right, key, inclusive, lower, right);
+		left = join_nodes(tree_left, tree, lower);
+	}
+	else
+	{
+		node* upper;
+		split_nodes(tree_left, key, inclusive, left, upper);
+		right = join_nodes(upper, tree, tree_right);
+	}
+}
+
+void AVL::split_first(node* tree, node*& first, node*& rest)
+{
+	if (!tree->left)
+	{
+		first = tree;
+		rest = tree->right;
+		return;
+	}
+
+	node* tree_right = tree->right;
+	node* left_rest;
+	split_first(tree->left, first, left_rest);
+	rest = join_nodes(left_rest, tree, tree_right);
+}
+
+void AVL::collect(node* subtree, std::vector<node*>& nodes)
+{
+	std::stack<node*> stack;
+	if (subtree) stack.push(subtree);
+
+	while (!stack.empty())
+	{
+		node* current_node = stack.top();
+		stack.pop();
+		nodes.push_back(current_node);
+
+		if (current_node->left) stack.push(current_node->left);
+		if (current_node->right) stack.push(current_node->right);
+	}
+}
+
+// The set operations split one tree around the root of the other and recurse
+// into the two halves independently, which is where the threads come in.
+// Nodes that leave the result are only collected here; freeing them happens
+// afterwards on the calling thread, since a node_pool is not thread-safe.
+AVL::node* AVL::union_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first) return second;
+	if (!second) return first;
+
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(second, first->key, false, lower, rest);
+	split_nodes(rest, first->key, true, equal, upper);
+	collect(equal, dropped);
+
+	node* first_left = first->left;
+	node* first_right = first->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = union_nodes(first_left, lower, forked_dropped, depth - 1); },
+		[&] { right = union_nodes(first_right, upper, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	return join_nodes(left, first, right);
+}
+
+AVL::node* AVL::intersect_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first || !second)
+	{
+		collect(first, dropped);
+		collect(second, dropped);
+		return nullptr;
+	}
+
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(second, first->key, false, lower, rest);
+	split_nodes(rest, first->key, true, equal, upper);
+	bool found = equal != nullptr;
+	collect(equal, dropped);
+
+	node* first_left = first->left;
+	node* first_right = first->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = intersect_nodes(first_left, lower, forked_dropped, depth - 1); },
+		[&] { right = intersect_nodes(first_right, upper, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	if (found)
+	{
+		return join_nodes(left, first, right);
+	}
+	dropped.push_back(first);
+	return join_nodes(left, right);
+}
+
+AVL::node* AVL::difference_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first || !second)
+	{
+		collect(second, dropped);
+		return first;
+	}
+
+	// here first is split around the root of second
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(first, second->key, false, lower, rest);
+	split_nodes(rest, second->key, true, equal, upper);
+	collect(equal, dropped);
+
+	node* second_left = second->left;
+	node* second_right = second->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = difference_nodes(lower, second_left, forked_dropped, depth - 1); },
+		[&] { right = difference_nodes(upper, second_right, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	dropped.push_back(second);
+	return join_nodes(left, right);
+}
+
+void AVL::set_root(node* new_root)
+{
+	root = new_root;
+	if (root) root->parent = nullptr;
+}
+
+// Nodes may only be relinked between trees that allocate from the same
+// place; otherwise other is rebuilt from this tree's pool first.
+void AVL::adopt(AVL& other)
+{
+	if (other.pool == pool)
+	{
+		return;
+	}
+
+	std::vector<int> keys;
+	for (node* current_node = min(other.root); current_node; current_node = succ(current_node))
+	{
+		keys.push_back(current_node->key);
+	}
+	other.release();
+	other.pool = pool;
+	other.build(keys.data(), keys.size());
+}
+
+void AVL::destroy_nodes(std::vector<node*>& nodes)
+{
+	for (node* current_node : nodes)
+	{
+		destroy_node(current_node);
+	}
+}
+
 
 
 
@@ -663,3 +1206,8 @@ void AVL::node::recalculate_height()
 	else if (!this->right)  this->height = this->left->height + 1;
 	else  this->height = std::max(this->left->height, this->right->height) + 1;
 }
+
+void AVL::node::recalculate_size()
+{
+	this->size = (this->left ? this->left->size : 0) + (this->right ? this->right->size : 0) + 1;
+}
\ No newline at end of file
@@ -3,6 +3,13 @@
 #include <string>
 #include <stack>
 #include <queue>
+#include <climits>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "../memory/node_pool.h"
+#include "../parallel/parallel_sort.h"
+#include "../parallel/fork_join.h"
 class AVL
 {
 public:
@@ -18,18 +25,22 @@ public:
 	{
 	public:
 		int key, height;
+		size_t size;	// nodes in this subtree, for rank() and select()
 		node* parent, * left, * right;
-		node(int key, node* parent = nullptr, int height = 0) :key(key), parent(parent), height(height),
+		node(int key, node* parent = nullptr, int height = 0) :key(key), parent(parent), height(height), size(1),
 			left(nullptr), right(nullptr) {}
 		int balance_factor();
 		void recalculate_height();
+		void recalculate_size();
 	};
 
 protected:
 	node* root;
+	std::shared_ptr<node_pool> pool;	// null: nodes come from new/delete
 
 public:
 	AVL();
+	explicit AVL(std::shared_ptr<node_pool> pool);
 	AVL(int*, size_t size);
 	~AVL();
 	AVL(const AVL& other);
@@ -38,6 +49,9 @@ public:
 	void insert(int key);
 	void remove(int key);
 
+	// replaces the contents with a perfectly balanced tree of keys
+	void build(const int* keys, size_t size);
+
 	void clear();
 
 	int max();
@@ -48,6 +62,29 @@ public:
 	int pred(int key);
 	bool find(int key);
 
+	size_t size();
+	// keys smaller than key
+	size_t rank(int key);
+	// k-th smallest key counting from 0, INT_MIN if there are not that many
+	int select(size_t k);
+	// keys in [low, high]
+	size_t count_range(int low, int high);
+
+	// Join-based operations. They relink the nodes of both trees instead of
+	// inserting, and the set operations work on the two trees in parallel.
+	// Trees are treated as sets: a key found in both is kept once.
+
+	// keys >= key move into greater, replacing what it held
+	void split(int key, AVL& greater);
+	// appends key and all of right, whose keys must not be less than key,
+	// while no key here may be greater than it; right is left empty
+	void join(int key, AVL& right);
+	void join(AVL& right);
+	// other is left empty
+	void union_with(AVL& other);
+	void intersect_with(AVL& other);
+	void difference_with(AVL& other);
+
 protected:
 
 	void print_preorder();
@@ -55,11 +92,42 @@ protected:
 	void print_postorder();
 	void print_tree();
 
+	static int balanced_height(size_t size);
+
 	void rotate_left(node*);
 	void rotate_right(node*);
 
 	void init(const AVL& other);
+	void release();
 	node* search(int key);
+	size_t count_below(int key, bool inclusive);
+	void update_sizes(node* from);
+
+	// below this many nodes a set operation is not worth a thread
+	static constexpr size_t parallel_grain = 1 << 14;
+
+	static int subtree_height(node* subtree);
+	static size_t subtree_size(node* subtree);
+	static node* make_node(node* left, node* middle, node* right);
+	static node* rotate_left_subtree(node* subtree);
+	static node* rotate_right_subtree(node* subtree);
+	static node* join_right(node* left, node* middle, node* right);
+	static node* join_left(node* left, node* middle, node* right);
+	static node* join_nodes(node* left, node* middle, node* right);
+	static node* join_nodes(node* left, node* right);
+	static void split_nodes(node* tree, int key, bool inclusive, node*& left, node*& right);
+	static void split_first(node* tree, node*& first, node*& rest);
+	static void collect(node* subtree, std::vector<node*>& nodes);
+	static node* union_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+	static node* intersect_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+	static node* difference_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+
+	void set_root(node* new_root);
+	void adopt(AVL& other);
+	void destroy_nodes(std::vector<node*>& nodes);
+
+	node* create_node(int key, node* parent = nullptr);
+	void destroy_node(node* node);
 	void remove(node* node);
 
 	node* max(node* root);
@@ -0,0 +1,322 @@
+#pragma once
+#include <iostream>
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <new>
+#include <utility>
+#include "control_group.h"
+#include "hash_functions.h"
+#include "table_stats.h"
+
+
+// Bucket arrays are built by hand rather than with new[], so that every list
+// gets the table's allocator instead of a default-constructed one of its own.
+template<typename bucket_type>
+inline bucket_type* new_buckets(size_t length, const typename bucket_type::allocator_type& alloc)
+{
+	bucket_type* buckets = static_cast<bucket_type*>(::operator new(sizeof(bucket_type) * length));
+	for (size_t index = 0; index < length; ++index)
+	{
+		new (buckets + index) bucket_type(alloc);
+	}
+	return buckets;
+}
+
+template<typename bucket_type>
+inline void delete_buckets(bucket_type* buckets, size_t length)
+{
+	if (buckets == nullptr) return;
+
+	for (size_t index = 0; index < length; ++index)
+	{
+		buckets[index].~bucket_type();
+	}
+	::operator delete(buckets);
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+class chained_storage
+{
+public:
+	using pair_type = std::pair<key, value>;
+	using bucket_type = std::list<pair_type, typename std::allocator_traits<allocator>::template rebind_alloc<pair_type>>;
+
+private:
+	typename bucket_type::allocator_type alloc;
+	bucket_type* arr;
+	size_t arr_length;
+	unsigned arr_shift;
+	size_t number_of_pairs;
+	hash hasher;
+
+	size_t get_index(size_t hash_code);
+	void init(const chained_storage& other);
+	void rehash(size_t new_length);
+public:
+	explicit chained_storage(const allocator& alloc = allocator());
+	chained_storage(const chained_storage& other);
+	chained_storage& operator=(const chained_storage& other);
+	~chained_storage();
+
+	template<typename lookup_key>
+	size_t hash_code(const lookup_key& current_key);
+	template<typename lookup_key>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code);
+	template<typename lookup_key, typename counter>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code, counter& probes);
+	template<typename... args>
+	pair_type* emplace(size_t hash_code, args&&... arguments);
+	template<typename lookup_key>
+	bool erase(const lookup_key& current_key, size_t hash_code);
+
+	bool needs_rehash();
+	void rehash();
+	void reserve(size_t pairs);
+	void prefetch(size_t hash_code);
+
+	float load_factor();
+	size_t size();
+	size_t bucket_count();
+	size_t max_chain_length();
+	void print();
+	template<typename function_type>
+	void for_each(function_type function);
+};
+
+
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline chained_storage<key, value, hash, allocator>::chained_storage(const allocator& alloc) : alloc(alloc)
+{
+	number_of_pairs = 0;
+	arr_length = 8;
+	arr_shift = fibonacci_shift(arr_length);
+	arr = new_buckets<bucket_type>(arr_length, this->alloc);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline chained_storage<key, value, hash, allocator>::chained_storage(const chained_storage& other) :
+	alloc(std::allocator_traits<typename bucket_type::allocator_type>::select_on_container_copy_construction(other.alloc))
+{
+	init(other);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline chained_storage<key, value, hash, allocator>& chained_storage<key, value, hash, allocator>::operator=(const chained_storage& other)
+{
+	if (this != &other)
+	{
+		delete_buckets(arr, arr_length);
+		init(other);
+	}
+
+	return *this;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline chained_storage<key, value, hash, allocator>::~chained_storage()
+{
+	delete_buckets(arr, arr_length);
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline size_t chained_storage<key, value, hash, allocator>::hash_code(const lookup_key& current_key)
+{
+	return hasher(current_key);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline typename chained_storage<key, value, hash, allocator>::pair_type* chained_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code)
+{
+	null_counter probes;
+	return lookup(current_key, hash_code, probes);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key, typename counter>
+inline typename chained_storage<key, value, hash, allocator>::pair_type* chained_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code, counter& probes)
+{
+	size_t index = get_index(hash_code);
+
+	for (auto itr = arr[index].begin(); itr != arr[index].end(); itr++)
+	{
+		++probes;
+		if (itr->first == current_key)
+		{
+			return &(*itr);
+		}
+	}
+	return nullptr;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename... args>
+inline typename chained_storage<key, value, hash, allocator>::pair_type* chained_storage<key, value, hash, allocator>::emplace(size_t hash_code, args&&... arguments)
+{
+	size_t index = get_index(hash_code);
+
+	++number_of_pairs;
+	arr[index].emplace_back(std::forward<args>(arguments)...);
+	return &(*arr[index].rbegin());
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline bool chained_storage<key, value, hash, allocator>::erase(const lookup_key& current_key, size_t hash_code)
+{
+	size_t index = get_index(hash_code);
+	auto itr = arr[index].begin();
+
+	while (itr != arr[index].end())
+	{
+		if (itr->first == current_key)
+		{
+			arr[index].erase(itr);
+			--number_of_pairs;
+			return true;
+		}
+		itr++;
+	}
+	return false;
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline bool chained_storage<key, value, hash, allocator>::needs_rehash()
+{
+	return number_of_pairs + 1 >= arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::rehash()
+{
+	rehash(arr_length * 2);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::rehash(size_t new_length)
+{
+	size_t old_arr_length = arr_length;
+	arr_length = new_length;
+	arr_shift = fibonacci_shift(arr_length);
+	bucket_type* temp = new_buckets<bucket_type>(arr_length, alloc);
+
+	for (size_t index = 0; index < old_arr_length; ++index)
+	{
+		// relink the existing nodes instead of copying every pair
+		while (!arr[index].empty())
+		{
+			size_t new_index = get_index(hasher(arr[index].front().first));
+			temp[new_index].splice(temp[new_index].end(), arr[index], arr[index].begin());
+		}
+	}
+	delete_buckets(arr, old_arr_length);
+	arr = temp;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::reserve(size_t pairs)
+{
+	// needs_rehash() fires once number_of_pairs + 1 reaches arr_length
+	size_t new_length = arr_length;
+	while (pairs + 1 >= new_length)
+	{
+		new_length *= 2;
+	}
+
+	if (new_length != arr_length)
+	{
+		rehash(new_length);
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::prefetch(size_t hash_code)
+{
+	prefetch_address(arr + get_index(hash_code));
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline float chained_storage<key, value, hash, allocator>::load_factor()
+{
+	return static_cast<float>(number_of_pairs) / arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t chained_storage<key, value, hash, allocator>::size()
+{
+	return number_of_pairs;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t chained_storage<key, value, hash, allocator>::bucket_count()
+{
+	return arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename function_type>
+inline void chained_storage<key, value, hash, allocator>::for_each(function_type function)
+{
+	for (size_t index = 0; index < arr_length; ++index)
+	{
+		for (const pair_type& pair : arr[index])
+		{
+			function(pair);
+		}
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t chained_storage<key, value, hash, allocator>::max_chain_length()
+{
+	size_t longest = 0;
+	for (size_t index = 0; index < arr_length; ++index)
+	{
+		longest = std::max(longest, arr[index].size());
+	}
+	return longest;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::print()
+{
+	for (size_t index = 0; index < arr_length; ++index)
+	{
+		std::cout << index << " : ";
+
+		for (const pair_type& pair : arr[index])
+		{
+			std::cout << "{" << pair.first << ", " << pair.second << "} ";
+		}
+		std::cout << "\n";
+	}
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t chained_storage<key, value, hash, allocator>::get_index(size_t hash_code)
+{
+	return fibonacci_index(hash_code, arr_shift);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void chained_storage<key, value, hash, allocator>::init(const chained_storage& other)
+{
+	arr_length = other.arr_length;
+	arr_shift = other.arr_shift;
+	number_of_pairs = other.number_of_pairs;
+	hasher = other.hasher;
+	arr = new_buckets<bucket_type>(arr_length, alloc);
+	for (size_t index = 0; index < arr_length; ++index)
+	{
+		arr[index] = other.arr[index];
+	}
+}
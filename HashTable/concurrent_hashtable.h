@@ -0,0 +1,355 @@
+#pragma once
+#include <atomic>
+#include <mutex>
+#include <utility>
+#include "../memory/epoch.h"
+#include "hash_functions.h"
+
+
+// Thread-safe hashtable split into independent shards, picked by the high bits
+// of the hash. Writers lock only their shard; readers take no lock at all and
+// walk the shard's chains under an epoch_guard. Nodes are never modified once
+// published: assigning a new value swaps in a fresh node, and a shard that
+// grows builds a new bucket array out of copies. Whatever the readers may
+// still be looking at is retired to the epoch domain instead of deleted.
+//
+// There is no operator[]: a reference into the table could outlive the node.
+template<typename key, typename value, typename hash = default_hash<key>>
+class concurrent_hashtable
+{
+private:
+	struct node
+	{
+		const std::pair<key, value> pair;
+		const size_t hash_code;
+		std::atomic<node*> next;
+
+		node(const std::pair<key, value>& pair, size_t hash_code, node* next) :
+			pair(pair), hash_code(hash_code), next(next) {}
+	};
+
+	struct bucket_array
+	{
+		size_t length;
+		unsigned shard_bits;
+		unsigned shift;
+		std::atomic<node*>* buckets;
+
+		bucket_array(size_t length, unsigned shard_bits);
+		~bucket_array();
+
+		// the shard took the top bits of hash_code, the bucket takes the next ones
+		std::atomic<node*>& bucket(size_t hash_code) { return buckets[(hash_code << shard_bits) >> shift]; }
+	};
+
+	struct alignas(64) shard
+	{
+		std::mutex lock;
+		std::atomic<bucket_array*> table;
+		std::atomic<size_t> number_of_pairs;
+	};
+
+	shard* shards;
+	size_t shard_count;
+	unsigned shard_shift;
+	hash hasher;
+
+	static constexpr size_t initial_buckets = 8;
+
+	size_t hash_code(const key& current_key) const;
+	shard& shard_of(size_t hash_code) const;
+	static node* search(bucket_array* table, const key& current_key, size_t hash_code);
+	void grow(shard& current_shard);
+	void link_new(shard& current_shard, const std::pair<key, value>& pair, size_t hash_code);
+	static void retire_chains(void* table);
+
+public:
+	// shard_count is rounded up to a power of two
+	concurrent_hashtable(size_t shard_count = 64);
+	~concurrent_hashtable();
+	concurrent_hashtable(const concurrent_hashtable&) = delete;
+	concurrent_hashtable& operator=(const concurrent_hashtable&) = delete;
+
+	bool insert(const std::pair<key, value>& pair);
+	void insert_or_assign(const std::pair<key, value>& pair);
+	bool remove(const key& current_key);
+
+	bool find(const key& current_key) const;
+	value get_value(const key& current_key) const;
+	bool try_get_value(const key& current_key, value& result) const;
+
+	size_t size() const;
+	float load_factor() const;
+};
+
+
+
+
+template<typename key, typename value, typename hash>
+inline concurrent_hashtable<key, value, hash>::bucket_array::bucket_array(size_t length, unsigned shard_bits) :
+	length(length), shard_bits(shard_bits), shift(fibonacci_shift(length))
+{
+	buckets = new std::atomic<node*>[length];
+	for (size_t index = 0; index < length; ++index)
+	{
+		buckets[index].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+template<typename key, typename value, typename hash>
+inline concurrent_hashtable<key, value, hash>::bucket_array::~bucket_array()
+{
+	delete[] buckets;
+}
+
+
+template<typename key, typename value, typename hash>
+inline concurrent_hashtable<key, value, hash>::concurrent_hashtable(size_t shard_count)
+{
+	unsigned shard_bits = 0;
+	while ((size_t(1) << shard_bits) < shard_count) ++shard_bits;
+
+	this->shard_count = size_t(1) << shard_bits;
+	shard_shift = sizeof(size_t) * 8 - shard_bits;
+	shards = new shard[this->shard_count];
+
+	for (size_t index = 0; index < this->shard_count; ++index)
+	{
+		shards[index].table.store(new bucket_array(initial_buckets, shard_bits), std::memory_order_relaxed);
+		shards[index].number_of_pairs.store(0, std::memory_order_relaxed);
+	}
+}
+
+template<typename key, typename value, typename hash>
+inline concurrent_hashtable<key, value, hash>::~concurrent_hashtable()
+{
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		bucket_array* table = shards[index].table.load();
+
+		for (size_t bucket = 0; bucket < table->length; ++bucket)
+		{
+			node* current_node = table->buckets[bucket].load();
+			while (current_node)
+			{
+				node* next = current_node->next.load();
+				delete current_node;
+				current_node = next;
+			}
+		}
+		delete table;
+	}
+	delete[] shards;
+}
+
+
+template<typename key, typename value, typename hash>
+inline size_t concurrent_hashtable<key, value, hash>::hash_code(const key& current_key) const
+{
+	// shards and then buckets come from the high bits, so spread identity hashes up there
+	return hasher(current_key) * static_cast<size_t>(0x9E3779B97F4A7C15ull);
+}
+
+template<typename key, typename value, typename hash>
+inline typename concurrent_hashtable<key, value, hash>::shard& concurrent_hashtable<key, value, hash>::shard_of(size_t hash_code) const
+{
+	return shards[shard_count == 1 ? 0 : hash_code >> shard_shift];
+}
+
+template<typename key, typename value, typename hash>
+inline typename concurrent_hashtable<key, value, hash>::node* concurrent_hashtable<key, value, hash>::search(bucket_array* table, const key& current_key, size_t hash_code)
+{
+	node* current_node = table->bucket(hash_code).load(std::memory_order_acquire);
+
+	while (current_node)
+	{
+		if (current_node->hash_code == hash_code && current_node->pair.first == current_key)
+		{
+			return current_node;
+		}
+		current_node = current_node->next.load(std::memory_order_acquire);
+	}
+	return nullptr;
+}
+
+
+template<typename key, typename value, typename hash>
+inline bool concurrent_hashtable<key, value, hash>::insert(const std::pair<key, value>& pair)
+{
+	size_t hash_code = this->hash_code(pair.first);
+	shard& current_shard = shard_of(hash_code);
+	std::lock_guard<std::mutex> lock(current_shard.lock);
+
+	bucket_array* table = current_shard.table.load(std::memory_order_relaxed);
+	if (search(table, pair.first, hash_code))
+	{
+		return false;
+	}
+
+	link_new(current_shard, pair, hash_code);
+	return true;
+}
+
+template<typename key, typename value, typename hash>
+inline void concurrent_hashtable<key, value, hash>::insert_or_assign(const std::pair<key, value>& pair)
+{
+	size_t hash_code = this->hash_code(pair.first);
+	shard& current_shard = shard_of(hash_code);
+	std::lock_guard<std::mutex> lock(current_shard.lock);
+
+	bucket_array* table = current_shard.table.load(std::memory_order_relaxed);
+	std::atomic<node*>* link = &table->bucket(hash_code);
+
+	for (node* current_node = link->load(std::memory_order_relaxed); current_node;
+		link = &current_node->next, current_node = link->load(std::memory_order_relaxed))
+	{
+		if (current_node->hash_code == hash_code && current_node->pair.first == pair.first)
+		{
+			// readers already on the old node keep a consistent pair and the same successor
+			link->store(new node(pair, hash_code, current_node->next.load(std::memory_order_relaxed)), std::memory_order_release);
+			epoch_domain::global().retire(current_node);
+			return;
+		}
+	}
+	link_new(current_shard, pair, hash_code);
+}
+
+template<typename key, typename value, typename hash>
+inline bool concurrent_hashtable<key, value, hash>::remove(const key& current_key)
+{
+	size_t hash_code = this->hash_code(current_key);
+	shard& current_shard = shard_of(hash_code);
+	std::lock_guard<std::mutex> lock(current_shard.lock);
+
+	bucket_array* table = current_shard.table.load(std::memory_order_relaxed);
+	std::atomic<node*>* link = &table->bucket(hash_code);
+
+	for (node* current_node = link->load(std::memory_order_relaxed); current_node;
+		link = &current_node->next, current_node = link->load(std::memory_order_relaxed))
+	{
+		if (current_node->hash_code == hash_code && current_node->pair.first == current_key)
+		{
+			link->store(current_node->next.load(std::memory_order_relaxed), std::memory_order_release);
+			current_shard.number_of_pairs.fetch_sub(1, std::memory_order_relaxed);
+			epoch_domain::global().retire(current_node);
+			return true;
+		}
+	}
+	return false;
+}
+
+
+template<typename key, typename value, typename hash>
+inline bool concurrent_hashtable<key, value, hash>::find(const key& current_key) const
+{
+	size_t hash_code = this->hash_code(current_key);
+	epoch_guard guard;
+
+	return search(shard_of(hash_code).table.load(std::memory_order_acquire), current_key, hash_code) != nullptr;
+}
+
+template<typename key, typename value, typename hash>
+inline value concurrent_hashtable<key, value, hash>::get_value(const key& current_key) const
+{
+	value result = value();
+	try_get_value(current_key, result);
+	return result;
+}
+
+template<typename key, typename value, typename hash>
+inline bool concurrent_hashtable<key, value, hash>::try_get_value(const key& current_key, value& result) const
+{
+	size_t hash_code = this->hash_code(current_key);
+	epoch_guard guard;
+
+	node* found = search(shard_of(hash_code).table.load(std::memory_order_acquire), current_key, hash_code);
+	if (found)
+	{
+		result = found->pair.second;
+		return true;
+	}
+	return false;
+}
+
+
+template<typename key, typename value, typename hash>
+inline size_t concurrent_hashtable<key, value, hash>::size() const
+{
+	size_t total = 0;
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		total += shards[index].number_of_pairs.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+template<typename key, typename value, typename hash>
+inline float concurrent_hashtable<key, value, hash>::load_factor() const
+{
+	size_t total_buckets = 0;
+	epoch_guard guard;
+
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		total_buckets += shards[index].table.load(std::memory_order_acquire)->length;
+	}
+	return static_cast<float>(size()) / total_buckets;
+}
+
+
+// Called with the shard locked. Readers may be anywhere in the old chains, so
+// they are copied rather than relinked and the old ones retired as a whole.
+template<typename key, typename value, typename hash>
+inline void concurrent_hashtable<key, value, hash>::grow(shard& current_shard)
+{
+	bucket_array* old_table = current_shard.table.load(std::memory_order_relaxed);
+	bucket_array* new_table = new bucket_array(old_table->length * 2, old_table->shard_bits);
+
+	for (size_t index = 0; index < old_table->length; ++index)
+	{
+		for (node* current_node = old_table->buckets[index].load(std::memory_order_relaxed); current_node;
+			current_node = current_node->next.load(std::memory_order_relaxed))
+		{
+			std::atomic<node*>& bucket = new_table->bucket(current_node->hash_code);
+			bucket.store(new node(current_node->pair, current_node->hash_code, bucket.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+		}
+	}
+
+	current_shard.table.store(new_table, std::memory_order_release);
+	epoch_domain::global().retire(old_table, retire_chains);
+}
+
+// Called with the shard locked and the key known to be absent.
+template<typename key, typename value, typename hash>
+inline void concurrent_hashtable<key, value, hash>::link_new(shard& current_shard, const std::pair<key, value>& pair, size_t hash_code)
+{
+	bucket_array* table = current_shard.table.load(std::memory_order_relaxed);
+
+	if (current_shard.number_of_pairs.load(std::memory_order_relaxed) + 1 > table->length)
+	{
+		grow(current_shard);
+		table = current_shard.table.load(std::memory_order_relaxed);
+	}
+
+	std::atomic<node*>& bucket = table->bucket(hash_code);
+	bucket.store(new node(pair, hash_code, bucket.load(std::memory_order_relaxed)), std::memory_order_release);
+	current_shard.number_of_pairs.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename key, typename value, typename hash>
+inline void concurrent_hashtable<key, value, hash>::retire_chains(void* pointer)
+{
+	bucket_array* table = static_cast<bucket_array*>(pointer);
+
+	for (size_t index = 0; index < table->length; ++index)
+	{
+		node* current_node = table->buckets[index].load(std::memory_order_relaxed);
+		while (current_node)
+		{
+			node* next = current_node->next.load(std::memory_order_relaxed);
+			delete current_node;
+			current_node = next;
+		}
+	}
+	delete table;
+}
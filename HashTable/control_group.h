@@ -0,0 +1,125 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HASHTABLE_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// Hint the cache to start loading address; used to overlap the memory
+// latency of several lookups in bulk operations.
+inline void prefetch_address(const void* address);
+
+// One control byte per slot: the sign bit is set for empty/deleted slots,
+// full slots hold the low 7 bits of the key's hash (the "fragment").
+enum control_byte : int8_t
+{
+	control_empty = -128,
+	control_deleted = -2
+};
+
+// Set of matching slots inside a group, bit i standing for slot i.
+class group_mask
+{
+private:
+	uint32_t mask;
+
+public:
+	explicit group_mask(uint32_t mask) : mask(mask) {}
+
+	bool any() const { return mask != 0; }
+	uint32_t lowest() const;
+	void pop_lowest() { mask &= mask - 1; }
+};
+
+// Sixteen control bytes scanned together. With SSE2 every match is a single
+// compare plus movemask, otherwise the bytes are checked one by one.
+struct alignas(16) control_group
+{
+	static constexpr size_t width = 16;
+
+	int8_t control[width];
+
+	group_mask match(int8_t fragment) const;
+	group_mask match_empty() const;
+	group_mask match_empty_or_deleted() const;
+};
+
+
+
+
+inline void prefetch_address(const void* address)
+{
+#if defined(HASHTABLE_USE_SSE2)
+	_mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#elif defined(__GNUC__)
+	__builtin_prefetch(address);
+#else
+	(void)address;
+#endif
+}
+
+inline uint32_t group_mask::lowest() const
+{
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return index;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+
+#if defined(HASHTABLE_USE_SSE2)
+
+inline group_mask control_group::match(int8_t fragment) const
+{
+	__m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(control));
+	return group_mask(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(fragment))));
+}
+
+inline group_mask control_group::match_empty() const
+{
+	return match(control_empty);
+}
+
+inline group_mask control_group::match_empty_or_deleted() const
+{
+	__m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(control));
+	return group_mask(_mm_movemask_epi8(group));
+}
+
+#else
+
+inline group_mask control_group::match(int8_t fragment) const
+{
+	uint32_t mask = 0;
+	for (size_t index = 0; index < width; ++index)
+	{
+		mask |= static_cast<uint32_t>(control[index] == fragment) << index;
+	}
+	return group_mask(mask);
+}
+
+inline group_mask control_group::match_empty() const
+{
+	return match(control_empty);
+}
+
+inline group_mask control_group::match_empty_or_deleted() const
+{
+	uint32_t mask = 0;
+	for (size_t index = 0; index < width; ++index)
+	{
+		mask |= static_cast<uint32_t>(control[index] < 0) << index;
+	}
+	return group_mask(mask);
+}
+
+#endif
@@ -0,0 +1,279 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+
+// Hash mixing layer for hashtable.
+//
+// std::hash is the identity for integers on libstdc++ and MSVC, so keys that
+// share low bits pile into the same buckets. The functors here finish every
+// hash with a 64x64->128 bit multiply-and-fold (the wyhash "mum" step), strings
+// are hashed with wyhash, and seeded_hash gives each table its own random seed
+// so bucket positions cannot be predicted by whoever chooses the keys.
+
+namespace hash_detail
+{
+	constexpr uint64_t secret[4] = { 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull, 0x8ebc6af09c88c6e3ull, 0x589965cc75374cc3ull };
+
+	// full 128-bit product of a and b, low half in a and high half in b
+	inline void multiply(uint64_t& a, uint64_t& b)
+	{
+#if defined(__SIZEOF_INT128__)
+		unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+		a = static_cast<uint64_t>(product);
+		b = static_cast<uint64_t>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+		a = _umul128(a, b, &b);
+#else
+		uint64_t a_high = a >> 32, a_low = static_cast<uint32_t>(a);
+		uint64_t b_high = b >> 32, b_low = static_cast<uint32_t>(b);
+		uint64_t high_high = a_high * b_high, high_low = a_high * b_low;
+		uint64_t low_high = a_low * b_high, low_low = a_low * b_low;
+		uint64_t middle = (low_low >> 32) + static_cast<uint32_t>(high_low) + static_cast<uint32_t>(low_high);
+		a = (middle << 32) | static_cast<uint32_t>(low_low);
+		b = high_high + (high_low >> 32) + (low_high >> 32) + (middle >> 32);
+#endif
+	}
+
+	inline uint64_t mix(uint64_t a, uint64_t b)
+	{
+		multiply(a, b);
+		return a ^ b;
+	}
+
+	inline uint64_t read8(const unsigned char* bytes)
+	{
+		uint64_t result;
+		std::memcpy(&result, bytes, sizeof(result));
+		return result;
+	}
+
+	inline uint64_t read4(const unsigned char* bytes)
+	{
+		uint32_t result;
+		std::memcpy(&result, bytes, sizeof(result));
+		return result;
+	}
+
+	inline uint64_t read3(const unsigned char* bytes, size_t length)
+	{
+		return (static_cast<uint64_t>(bytes[0]) << 16) | (static_cast<uint64_t>(bytes[length >> 1]) << 8) | bytes[length - 1];
+	}
+}
+
+
+// wyhash (final version 4) of length bytes at data.
+inline uint64_t wyhash(const void* data, size_t length, uint64_t seed = 0)
+{
+	using namespace hash_detail;
+
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t a, b;
+
+	seed ^= mix(seed ^ secret[0], secret[1]);
+
+	if (length <= 16)
+	{
+		if (length >= 4)
+		{
+			a = (read4(bytes) << 32) | read4(bytes + ((length >> 3) << 2));
+			b = (read4(bytes + length - 4) << 32) | read4(bytes + length - 4 - ((length >> 3) << 2));
+		}
+		else if (length > 0)
+		{
+			a = read3(bytes, length);
+			b = 0;
+		}
+		else
+		{
+			a = b = 0;
+		}
+	}
+	else
+	{
+		size_t remaining = length;
+
+		if (remaining > 48)
+		{
+			uint64_t seed1 = seed, seed2 = seed;
+			do
+			{
+				seed = mix(read8(bytes) ^ secret[1], read8(bytes + 8) ^ seed);
+				seed1 = mix(read8(bytes + 16) ^ secret[2], read8(bytes + 24) ^ seed1);
+				seed2 = mix(read8(bytes + 32) ^ secret[3], read8(bytes + 40) ^ seed2);
+				bytes += 48;
+				remaining -= 48;
+			} while (remaining > 48);
+			seed ^= seed1 ^ seed2;
+		}
+
+		while (remaining > 16)
+		{
+			seed = mix(read8(bytes) ^ secret[1], read8(bytes + 8) ^ seed);
+			bytes += 16;
+			remaining -= 16;
+		}
+
+		a = read8(bytes + remaining - 16);
+		b = read8(bytes + remaining - 8);
+	}
+
+	a ^= secret[1];
+	b ^= seed;
+	multiply(a, b);
+	return mix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+// Multiplicative finalizer: spreads every input bit over the whole result.
+inline uint64_t hash_mix(uint64_t value, uint64_t seed = 0)
+{
+	return hash_detail::mix(value ^ seed ^ hash_detail::secret[0], hash_detail::secret[1]);
+}
+
+
+// Transparent string hash: std::string, std::string_view and const char* keys
+// all hash the same, so a hashtable<std::string, ...> using it can be searched
+// without building a temporary std::string.
+struct string_hash
+{
+	using is_transparent = void;
+
+	uint64_t seed;
+
+	explicit string_hash(uint64_t seed = 0) : seed(seed) {}
+
+	size_t operator()(std::string_view text) const
+	{
+		return static_cast<size_t>(wyhash(text.data(), text.size(), seed));
+	}
+};
+
+// Integers and enums through the multiplicative finalizer instead of the identity.
+template<typename T>
+struct integer_hash
+{
+	uint64_t seed;
+
+	explicit integer_hash(uint64_t seed = 0) : seed(seed) {}
+
+	size_t operator()(T value) const
+	{
+		return static_cast<size_t>(hash_mix(static_cast<uint64_t>(value), seed));
+	}
+};
+
+// Default hash of hashtable: mixed for integers, wyhash for strings,
+// std::hash for everything else. The seeded ones keep their seed constructor,
+// so that seeded_hash<default_hash<key>> seeds them directly.
+template<typename key, typename = void>
+struct default_hash : std::hash<key> {};
+
+template<typename key>
+struct default_hash<key, std::enable_if_t<std::is_integral<key>::value || std::is_enum<key>::value>> : integer_hash<key>
+{
+	using integer_hash<key>::integer_hash;
+};
+
+template<>
+struct default_hash<std::string> : string_hash
+{
+	using string_hash::string_hash;
+};
+
+template<>
+struct default_hash<std::string_view> : string_hash
+{
+	using string_hash::string_hash;
+};
+
+
+// True when hash declares is_transparent, i.e. accepts other key types.
+template<typename hash, typename = void>
+struct is_transparent : std::false_type {};
+
+template<typename hash>
+struct is_transparent<hash, std::void_t<typename hash::is_transparent>> : std::true_type {};
+
+
+inline uint64_t random_seed()
+{
+	static std::random_device device;
+	uint64_t entropy = (static_cast<uint64_t>(device()) << 32) ^ device();
+	return hash_mix(entropy, static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+}
+
+template<typename hash, bool transparent = is_transparent<hash>::value>
+struct seeded_hash_base {};
+
+template<typename hash>
+struct seeded_hash_base<hash, true>
+{
+	using is_transparent = void;
+};
+
+// Wraps hash with a seed drawn at random for every instance. Hashes that take
+// a seed themselves (string_hash, integer_hash) get it passed in; any other
+// hash has the seed mixed into its result.
+template<typename hash>
+class seeded_hash : public seeded_hash_base<hash>
+{
+private:
+	static constexpr bool takes_seed = std::is_constructible<hash, uint64_t>::value;
+
+	uint64_t seed;
+	hash hasher;
+
+	template<typename H = hash, std::enable_if_t<std::is_constructible<H, uint64_t>::value, int> = 0>
+	static H make_hasher(uint64_t seed) { return H(seed); }
+	template<typename H = hash, std::enable_if_t<!std::is_constructible<H, uint64_t>::value, int> = 0>
+	static H make_hasher(uint64_t) { return H(); }
+
+public:
+	seeded_hash() : seed(random_seed()), hasher(make_hasher(seed)) {}
+
+	template<typename lookup_key>
+	size_t operator()(const lookup_key& current_key) const
+	{
+		if constexpr (takes_seed)
+		{
+			return hasher(current_key);
+		}
+		else
+		{
+			return static_cast<size_t>(hash_mix(hasher(current_key), seed));
+		}
+	}
+};
+
+// mixing the seed into the result would keep every collision of the unseeded
+// hash, so the default hashes must take it themselves
+static_assert(std::is_constructible<default_hash<std::string>, uint64_t>::value, "default_hash<std::string> must take a seed");
+static_assert(std::is_constructible<default_hash<std::string_view>, uint64_t>::value, "default_hash<std::string_view> must take a seed");
+static_assert(std::is_constructible<default_hash<uint64_t>, uint64_t>::value, "default_hash of integers must take a seed");
+
+
+// Multiplicative (Fibonacci) reduction of a hash to one of 2^(64 - shift)
+// buckets: keeps the high bits of hash_code * 2^64/phi, which depend on every
+// input bit, and costs a multiply and a shift instead of a division.
+inline size_t fibonacci_index(size_t hash_code, unsigned shift)
+{
+	return static_cast<size_t>((static_cast<uint64_t>(hash_code) * 0x9E3779B97F4A7C15ull) >> shift);
+}
+
+// shift for fibonacci_index over length buckets, length a power of two
+inline unsigned fibonacci_shift(size_t length)
+{
+	unsigned bits = 0;
+	while ((size_t(1) << bits) < length) ++bits;
+	return 64 - bits;
+}
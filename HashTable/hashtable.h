@@ -1,209 +1,385 @@
 #pragma once
 #include <iostream>
+#include <iterator>
 #include <list>
 #include <vector>
 #include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "hash_functions.h"
+#include "table_stats.h"
+#include "chained_storage.h"
+#include "open_addressing_storage.h"
+#include "incremental_storage.h"
+
+
+// Layout policies: pick how the table stores its pairs.
+// chained_layout keeps one std::list per bucket, open_addressing_layout keeps
+// every pair in one flat array and probes it in groups of 16 slots,
+// incremental_layout is chained but spreads each rehash over later operations.
+struct chained_layout
+{
+	template<typename key, typename value, typename hash, typename allocator>
+	using storage = chained_storage<key, value, hash, allocator>;
+};
 
+struct open_addressing_layout
+{
+	template<typename key, typename value, typename hash, typename allocator>
+	using storage = open_addressing_storage<key, value, hash, allocator>;
+};
 
-template<typename key, typename value, typename hash = std::hash<key>>
+struct incremental_layout
+{
+	template<typename key, typename value, typename hash, typename allocator>
+	using storage = incremental_storage<key, value, hash, allocator>;
+};
+
+
+// hash defaults to default_hash (see hash_functions.h); wrap it in seeded_hash
+// when the keys come from outside. stats_policy is no_stats (nothing recorded,
+// no cost) or table_stats (probe histogram, rehash count/time); see statistics().
+// allocator places the pairs; with pool_allocator (memory/node_pool.h) the list
+// nodes of the chained layouts come out of one shared slab pool.
+template<typename key, typename value, typename hash = default_hash<key>, typename layout = chained_layout, typename stats_policy = no_stats,
+	typename allocator = std::allocator<std::pair<key, value>>>
 class hashtable
 {
 private:
-	std::list<std::pair<key, value>>* arr;
-	size_t arr_length;
-	size_t number_of_pairs;
+	typename layout::template storage<key, value, hash, allocator> storage;
+	stats_policy stats;
 
-	void rehash();
-	size_t get_index(key);
-	void init(const hashtable& other);
-public:
-	hashtable();
-	hashtable(const hashtable& other);
-	hashtable<key, value, hash> operator=(const hashtable& other);
-	~hashtable();
+	// lookups by anything other than key need a transparent hash (see string_hash)
+	template<typename lookup_key>
+	using heterogeneous = std::enable_if_t<is_transparent<hash>::value && !std::is_same<std::decay_t<lookup_key>, key>::value>;
+
+	template<typename lookup_key, typename... args>
+	bool try_emplace_key(lookup_key&& current_key, args&&... arguments);
+	template<typename lookup_key>
+	value& find_or_emplace(lookup_key&& current_key);
+	template<typename lookup_key>
+	std::pair<key, value>* lookup(const lookup_key& current_key, size_t hash_code);
+	void grow_if_needed();
 
+	// pairs hashed ahead of placement in bulk inserts
+	static constexpr size_t insert_batch = 32;
 
-	void insert(std::pair<key, value>);
-	value get_value(key);
+	template<typename iterator>
+	void insert(iterator first, iterator last, std::input_iterator_tag);
+	template<typename iterator>
+	void insert(iterator first, iterator last, std::forward_iterator_tag);
+
+public:
+	hashtable();
+	explicit hashtable(const allocator& alloc);
+	explicit hashtable(size_t capacity, const allocator& alloc = allocator());
+
+	void reserve(size_t pairs);
+	size_t size();
+	hashtable_stats statistics();
+
+	void insert(const std::pair<key, value>& pair);
+	void insert(std::pair<key, value>&& pair);
+	template<typename iterator>
+	void insert(iterator first, iterator last);
+	template<typename... args>
+	bool emplace(args&&... arguments);
+	template<typename... args>
+	bool try_emplace(const key& current_key, args&&... arguments);
+	template<typename... args>
+	bool try_emplace(key&& current_key, args&&... arguments);
+
+	value get_value(const key& current_key);
 	float load_factor();
 	void print();
-	bool find(key);
-	void remove(key);
-	value& operator[](key);
+	template<typename function_type>
+	void for_each(function_type function);
+	bool find(const key& current_key);
+	void remove(const key& current_key);
+	value& operator[](const key& current_key);
+	value& operator[](key&& current_key);
+
+	template<typename lookup_key, typename = heterogeneous<lookup_key>>
+	value get_value(const lookup_key& current_key);
+	template<typename lookup_key, typename = heterogeneous<lookup_key>>
+	bool find(const lookup_key& current_key);
+	template<typename lookup_key, typename = heterogeneous<lookup_key>>
+	void remove(const lookup_key& current_key);
 };
 
 
 
 
-template<typename key, typename value, typename hash>
-inline hashtable<key, value, hash>::hashtable()
-{
-	number_of_pairs = 0;
-	arr_length = 7;
-	arr = new std::list<std::pair<key, value>>[arr_length];
-}
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline hashtable<key, value, hash, layout, stats_policy, allocator>::hashtable() {}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline hashtable<key, value, hash, layout, stats_policy, allocator>::hashtable(const allocator& alloc) : storage(alloc) {}
 
-template<typename key, typename value, typename hash>
-inline hashtable<key, value, hash>::hashtable(const hashtable& other)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline hashtable<key, value, hash, layout, stats_policy, allocator>::hashtable(size_t capacity, const allocator& alloc) : storage(alloc)
 {
-	init(other);
+	reserve(capacity);
 }
 
-template<typename key, typename value, typename hash>
-inline hashtable<key, value, hash> hashtable<key, value, hash>::operator=(const hashtable& other)
+// Size the table for pairs entries up front, so loading them never rehashes.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::reserve(size_t pairs)
 {
-	if (arr != nullptr) this->~hashtable();
-	init();
+	size_t old_bucket_count = storage.bucket_count();
 
-	return *this;
+	stats.start_rehash();
+	storage.reserve(pairs);
+	if (storage.bucket_count() != old_bucket_count)
+	{
+		stats.end_rehash();
+	}
 }
 
-
-
-template<typename key, typename value, typename hash>
-inline hashtable<key, value, hash>::~hashtable()
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline size_t hashtable<key, value, hash, layout, stats_policy, allocator>::size()
 {
-	delete[] arr;
+	return storage.size();
 }
 
+// Snapshot of the table's shape plus, with table_stats, what was recorded so
+// far. max_chain_length walks the whole table, so this is not for hot paths.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+hashtable_stats hashtable<key, value, hash, layout, stats_policy, allocator>::statistics()
+{
+	hashtable_stats snapshot;
+	snapshot.size = storage.size();
+	snapshot.bucket_count = storage.bucket_count();
+	snapshot.load_factor = storage.load_factor();
+	snapshot.max_chain_length = storage.max_chain_length();
+	stats.fill(snapshot);
+	return snapshot;
+}
 
-template<typename key, typename value, typename hash>
-inline void hashtable<key, value, hash>::insert(std::pair<key, value> pair)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key>
+inline std::pair<key, value>* hashtable<key, value, hash, layout, stats_policy, allocator>::lookup(const lookup_key& current_key, size_t hash_code)
 {
-	++number_of_pairs;
-	if (load_factor() >= 1) rehash();
+	typename stats_policy::counter probes;
+	std::pair<key, value>* found = storage.lookup(current_key, hash_code, probes);
+	stats.record_lookup(probes);
+	return found;
+}
 
-	if (!find(pair.first))
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::grow_if_needed()
+{
+	if (storage.needs_rehash())
 	{
-		size_t index = get_index(pair.first);
-		arr[index].emplace_back(pair);
+		stats.start_rehash();
+		storage.rehash();
+		stats.end_rehash();
 	}
 }
 
 
-template<typename key, typename value, typename hash>
-inline float hashtable<key, value, hash>::load_factor()
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::insert(const std::pair<key, value>& pair)
 {
-	return number_of_pairs / arr_length;
+	try_emplace_key(pair.first, pair.second);
 }
 
-template<typename key, typename value, typename hash>
-inline void hashtable<key, value, hash>::print()
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::insert(std::pair<key, value>&& pair)
 {
-	for (int index = 0; index < arr_length; ++index)
-	{
-		std::cout << index << " : ";
-
-		for (std::pair<key, value> pair : arr[index])
-		{
-			std::cout << "{" << pair.first << ", " << pair.second << "} ";
-		}
-		std::cout << "\n";
-	}
+	try_emplace_key(std::move(pair.first), std::move(pair.second));
 }
 
-template<typename key, typename value, typename hash>
-inline bool hashtable<key, value, hash>::find(key current_key)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename iterator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::insert(iterator first, iterator last)
 {
-	size_t index = get_index(current_key);
+	insert(first, last, typename std::iterator_traits<iterator>::iterator_category());
+}
 
-	for (std::pair<key, value> pair : arr[index])
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename iterator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::insert(iterator first, iterator last, std::input_iterator_tag)
+{
+	for (; first != last; ++first)
 	{
-		if (pair.first == current_key)
-		{
-			return true;
-		}
+		insert(*first);
 	}
-	return false;
 }
 
-template<typename key, typename value, typename hash>
-inline void hashtable<key, value, hash>::remove(key current_key)
+// Bulk load: the table is sized once for the whole range, then pairs go in
+// batches: the batch is hashed and its buckets prefetched first, so the cache
+// misses of one batch overlap instead of being paid one insert at a time.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename iterator>
+void hashtable<key, value, hash, layout, stats_policy, allocator>::insert(iterator first, iterator last, std::forward_iterator_tag)
 {
-	size_t index = get_index(current_key);
-	auto itr = arr[index].begin();
+	reserve(storage.size() + std::distance(first, last));
+
+	size_t hash_codes[insert_batch];
 
-	while (itr != arr[index].end())
+	while (first != last)
 	{
-		if (itr->first == current_key)
+		iterator batch_first = first;
+		size_t batch_size = 0;
+
+		for (; first != last && batch_size < insert_batch; ++first, ++batch_size)
+		{
+			hash_codes[batch_size] = storage.hash_code(first->first);
+			storage.prefetch(hash_codes[batch_size]);
+		}
+
+		for (size_t index = 0; index < batch_size; ++index, ++batch_first)
 		{
-			arr[index].erase(itr);
-			--arr_length;
-			break;
+			if (!lookup(batch_first->first, hash_codes[index]))
+			{
+				grow_if_needed();
+				storage.emplace(hash_codes[index], *batch_first);
+			}
 		}
-		itr++;
 	}
 }
 
-template<typename key, typename value, typename hash>
-value& hashtable<key, value, hash>::operator[](key current_key)
+// The key has to exist before it can be hashed, so the pair is built up front
+// and moved in; prefer try_emplace when the key is already at hand.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename... args>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::emplace(args&&... arguments)
 {
-	size_t index = get_index(current_key);
+	std::pair<key, value> pair(std::forward<args>(arguments)...);
+	return try_emplace_key(std::move(pair.first), std::move(pair.second));
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename... args>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::try_emplace(const key& current_key, args&&... arguments)
+{
+	return try_emplace_key(current_key, std::forward<args>(arguments)...);
+}
 
-	for (auto itr = (arr[index]).begin(); itr != arr[index].end(); itr++)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename... args>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::try_emplace(key&& current_key, args&&... arguments)
+{
+	return try_emplace_key(std::move(current_key), std::forward<args>(arguments)...);
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key, typename... args>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::try_emplace_key(lookup_key&& current_key, args&&... arguments)
+{
+	size_t hash_code = storage.hash_code(current_key);
+
+	if (lookup(current_key, hash_code))
 	{
-		if (itr->first == current_key)
-		{
-			return itr->second;
-		}
+		return false;
 	}
 
-	std::pair<key, value> pair;
-	pair.first = current_key;
+	grow_if_needed();
+	storage.emplace(hash_code, std::piecewise_construct,
+		std::forward_as_tuple(std::forward<lookup_key>(current_key)),
+		std::forward_as_tuple(std::forward<args>(arguments)...));
+	return true;
+}
+
 
-	arr[index].emplace_back(pair);
-	return arr[index].rbegin()->second;
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline float hashtable<key, value, hash, layout, stats_policy, allocator>::load_factor()
+{
+	return storage.load_factor();
 }
 
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::print()
+{
+	storage.print();
+}
 
-template<typename key, typename value, typename hash>
-inline void hashtable<key, value, hash>::rehash()
+// Calls function(const std::pair<key, value>&) once per stored pair, in no particular order.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename function_type>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::for_each(function_type function)
 {
-	size_t old_arr_length = arr_length;
-	arr_length = arr_length * 2 - 1;
-	std::list<std::pair<key, value>>* temp = new std::list<std::pair<key, value>>[arr_length];
+	storage.for_each(function);
+}
 
-	for (int index = 0; index < old_arr_length; ++index)
-	{
-		for (auto pair : arr[index])
-		{
-			int new_index = get_index(pair.first);
-			temp[new_index].emplace_back(pair);
-		}
-	}
-	delete[] arr;
-	arr = temp;
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::find(const key& current_key)
+{
+	return lookup(current_key, storage.hash_code(current_key)) != nullptr;
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key, typename>
+inline bool hashtable<key, value, hash, layout, stats_policy, allocator>::find(const lookup_key& current_key)
+{
+	return lookup(current_key, storage.hash_code(current_key)) != nullptr;
 }
 
-template<typename key, typename value, typename hash>
-size_t hashtable<key, value, hash>::get_index(key current_key)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::remove(const key& current_key)
 {
-	return hash()(current_key) % arr_length;
+	storage.erase(current_key, storage.hash_code(current_key));
 }
 
-template<typename key, typename value, typename hash>
-void hashtable<key, value, hash>::init(const hashtable& other)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key, typename>
+inline void hashtable<key, value, hash, layout, stats_policy, allocator>::remove(const lookup_key& current_key)
 {
-	arr_length = other.arr_length;
-	number_of_pairs = other.number_of_pairs/*)*/;
-	arr = new std::list<std::pair<key, value>>[arr_length];
-	for (size_t index = 0; index < arr_length; ++index)
+	storage.erase(current_key, storage.hash_code(current_key));
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline value& hashtable<key, value, hash, layout, stats_policy, allocator>::operator[](const key& current_key)
+{
+	return find_or_emplace(current_key);
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline value& hashtable<key, value, hash, layout, stats_policy, allocator>::operator[](key&& current_key)
+{
+	return find_or_emplace(std::move(current_key));
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key>
+value& hashtable<key, value, hash, layout, stats_policy, allocator>::find_or_emplace(lookup_key&& current_key)
+{
+	size_t hash_code = storage.hash_code(current_key);
+	std::pair<key, value>* found = lookup(current_key, hash_code);
+
+	if (found)
 	{
-		arr[index] = other.arr[index];
+		return found->second;
 	}
+
+	grow_if_needed();
+	return storage.emplace(hash_code, std::piecewise_construct,
+		std::forward_as_tuple(std::forward<lookup_key>(current_key)), std::forward_as_tuple())->second;
 }
 
-template<typename key, typename value, typename hash>
-inline value hashtable<key, value, hash>::get_value(key current_key)
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+inline value hashtable<key, value, hash, layout, stats_policy, allocator>::get_value(const key& current_key)
 {
-	size_t index = get_index(current_key);
+	std::pair<key, value>* found = lookup(current_key, storage.hash_code(current_key));
 
-	for (std::pair<key, value> pair : arr[index])
+	if (found)
 	{
-		if (pair.first == current_key)
-		{
-			return pair.second;
-		}
+		return found->second;
+	}
+	return value();
+}
+
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+template<typename lookup_key, typename>
+inline value hashtable<key, value, hash, layout, stats_policy, allocator>::get_value(const lookup_key& current_key)
+{
+	std::pair<key, value>* found = lookup(current_key, storage.hash_code(current_key));
+
+	if (found)
+	{
+		return found->second;
 	}
 	return value();
-}
\ No newline at end of file
+}
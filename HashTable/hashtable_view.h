@@ -0,0 +1,433 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include "hashtable.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// On-disk snapshot of a hashtable that is used in place through mmap.
+//
+// File layout, every offset relative to the start of the file:
+//   snapshot_header
+//   control bytes, one per slot: 0 for empty, 0x80 | 7 hash bits for full
+//   slots, slot_size bytes each: 64-bit hash, key field, value field
+//   string arena holding the characters of std::string keys/values
+//
+// The slots form a linear-probing table at most half full. Trivially copyable
+// keys and values are stored by value; std::string is stored as an
+// (offset, length) pair into the arena, so nothing in the file is a pointer
+// and the image works at whatever address it gets mapped. The hash is FNV-1a
+// over the key bytes, independent of the table's own hash, so a snapshot
+// stays readable by any build.
+
+struct snapshot_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t slot_size;
+	uint32_t key_size;
+	uint32_t value_size;
+	uint64_t slot_count;
+	uint64_t number_of_pairs;
+	uint64_t control_offset;
+	uint64_t slots_offset;
+	uint64_t arena_offset;
+	uint64_t arena_size;
+};
+
+inline constexpr char snapshot_magic[8] = { 'H', 'T', 'S', 'N', 'A', 'P', '0', '1' };
+inline constexpr uint32_t snapshot_version = 1;
+
+
+inline uint64_t snapshot_hash(const void* data, size_t length)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash_code = 14695981039346656037ull;
+
+	for (size_t index = 0; index < length; ++index)
+	{
+		hash_code ^= bytes[index];
+		hash_code *= 1099511628211ull;
+	}
+	return hash_code;
+}
+
+
+// How one key or value type is laid out in a snapshot.
+template<typename T, typename = void>
+struct snapshot_traits
+{
+	static_assert(std::is_trivially_copyable<T>::value,
+		"snapshots store trivially copyable types and std::string only");
+
+	using view_type = T;
+	static constexpr size_t stored_size = sizeof(T);
+
+	static void store(const T& object, unsigned char* field, std::string&)
+	{
+		std::memcpy(field, &object, sizeof(T));
+	}
+
+	static view_type load(const unsigned char* field, const char*)
+	{
+		T object;
+		std::memcpy(&object, field, sizeof(T));
+		return object;
+	}
+
+	static uint64_t hash(const view_type& object)
+	{
+		static_assert(std::has_unique_object_representations<T>::value,
+			"snapshot keys are hashed by their bytes, so they must not contain padding");
+		return snapshot_hash(&object, sizeof(T));
+	}
+};
+
+template<>
+struct snapshot_traits<std::string>
+{
+	using view_type = std::string_view;
+	static constexpr size_t stored_size = 2 * sizeof(uint64_t);
+
+	static void store(const std::string& object, unsigned char* field, std::string& arena)
+	{
+		uint64_t location[2] = { arena.size(), object.size() };
+		arena += object;
+		std::memcpy(field, location, sizeof(location));
+	}
+
+	static view_type load(const unsigned char* field, const char* arena)
+	{
+		uint64_t location[2];
+		std::memcpy(location, field, sizeof(location));
+		return std::string_view(arena + location[0], location[1]);
+	}
+
+	static uint64_t hash(const view_type& object)
+	{
+		return snapshot_hash(object.data(), object.size());
+	}
+};
+
+
+// Writes table to path in the format above. Returns false if the file could
+// not be written.
+template<typename key, typename value, typename hash, typename layout, typename stats_policy, typename allocator>
+bool save_snapshot(hashtable<key, value, hash, layout, stats_policy, allocator>& table, const std::string& path)
+{
+	using key_traits = snapshot_traits<key>;
+	using value_traits = snapshot_traits<value>;
+
+	const size_t slot_size = (sizeof(uint64_t) + key_traits::stored_size + value_traits::stored_size + 7) / 8 * 8;
+
+	size_t slot_count = 16;
+	while (slot_count < table.size() * 2)
+	{
+		slot_count *= 2;
+	}
+
+	std::vector<unsigned char> control(slot_count, 0);
+	std::vector<unsigned char> slots(slot_count * slot_size, 0);
+	std::string arena;
+
+	table.for_each([&](const std::pair<key, value>& pair)
+		{
+			uint64_t hash_code = key_traits::hash(pair.first);
+			size_t index = hash_code & (slot_count - 1);
+
+			while (control[index] != 0)
+			{
+				index = (index + 1) & (slot_count - 1);
+			}
+
+			unsigned char* slot = slots.data() + index * slot_size;
+			control[index] = static_cast<unsigned char>(0x80 | (hash_code >> 57));
+			std::memcpy(slot, &hash_code, sizeof(hash_code));
+			key_traits::store(pair.first, slot + sizeof(uint64_t), arena);
+			value_traits::store(pair.second, slot + sizeof(uint64_t) + key_traits::stored_size, arena);
+		});
+
+	snapshot_header header;
+	std::memcpy(header.magic, snapshot_magic, sizeof(header.magic));
+	header.version = snapshot_version;
+	header.slot_size = static_cast<uint32_t>(slot_size);
+	header.key_size = static_cast<uint32_t>(key_traits::stored_size);
+	header.value_size = static_cast<uint32_t>(value_traits::stored_size);
+	header.slot_count = slot_count;
+	header.number_of_pairs = table.size();
+	header.control_offset = sizeof(snapshot_header);
+	header.slots_offset = (header.control_offset + slot_count + 63) / 64 * 64;
+	header.arena_offset = header.slots_offset + slots.size();
+	header.arena_size = arena.size();
+
+	std::FILE* file = std::fopen(path.c_str(), "wb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	static const char padding[64] = {};
+	bool written =
+		std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+		std::fwrite(control.data(), 1, control.size(), file) == control.size() &&
+		std::fwrite(padding, 1, header.slots_offset - header.control_offset - slot_count, file) == header.slots_offset - header.control_offset - slot_count &&
+		std::fwrite(slots.data(), 1, slots.size(), file) == slots.size() &&
+		std::fwrite(arena.data(), 1, arena.size(), file) == arena.size();
+
+	return std::fclose(file) == 0 && written;
+}
+
+
+// Read-only table served straight from a mapped snapshot file; opening costs
+// one mmap and pages are loaded (and shared between processes) on demand.
+// Lookups take key_view, which is std::string_view for std::string keys.
+template<typename key, typename value>
+class hashtable_view
+{
+public:
+	using key_view = typename snapshot_traits<key>::view_type;
+	using value_view = typename snapshot_traits<value>::view_type;
+
+private:
+	using key_traits = snapshot_traits<key>;
+	using value_traits = snapshot_traits<value>;
+
+	const unsigned char* mapping;
+	size_t mapping_size;
+	const snapshot_header* header;
+	const unsigned char* control;
+	const unsigned char* slots;
+	const char* arena;
+#if defined(_WIN32)
+	HANDLE file_handle;
+	HANDLE mapping_handle;
+#endif
+
+	const unsigned char* lookup(const key_view& current_key) const;
+	bool validate() const;
+public:
+	hashtable_view();
+	explicit hashtable_view(const std::string& path);
+	~hashtable_view();
+	hashtable_view(const hashtable_view&) = delete;
+	hashtable_view& operator=(const hashtable_view&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+	bool is_open() const;
+
+	bool find(const key_view& current_key) const;
+	value_view get_value(const key_view& current_key) const;
+	size_t size() const;
+};
+
+
+
+
+template<typename key, typename value>
+inline hashtable_view<key, value>::hashtable_view() :
+	mapping(nullptr), mapping_size(0), header(nullptr), control(nullptr), slots(nullptr), arena(nullptr)
+#if defined(_WIN32)
+	, file_handle(INVALID_HANDLE_VALUE), mapping_handle(nullptr)
+#endif
+{}
+
+template<typename key, typename value>
+inline hashtable_view<key, value>::hashtable_view(const std::string& path) : hashtable_view()
+{
+	open(path);
+}
+
+template<typename key, typename value>
+inline hashtable_view<key, value>::~hashtable_view()
+{
+	close();
+}
+
+
+template<typename key, typename value>
+bool hashtable_view<key, value>::open(const std::string& path)
+{
+	close();
+
+#if defined(_WIN32)
+	file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	mapping_size = static_cast<size_t>(file_size.QuadPart);
+
+	mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	mapping = static_cast<const unsigned char*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+#else
+	int descriptor = ::open(path.c_str(), O_RDONLY);
+	if (descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat file_status;
+	if (fstat(descriptor, &file_status) != 0 || file_status.st_size == 0)
+	{
+		::close(descriptor);
+		return false;
+	}
+	mapping_size = static_cast<size_t>(file_status.st_size);
+
+	void* address = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, descriptor, 0);
+	::close(descriptor);
+	mapping = address == MAP_FAILED ? nullptr : static_cast<const unsigned char*>(address);
+#endif
+
+	if (mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	header = reinterpret_cast<const snapshot_header*>(mapping);
+	if (!validate())
+	{
+		close();
+		return false;
+	}
+
+	control = mapping + header->control_offset;
+	slots = mapping + header->slots_offset;
+	arena = reinterpret_cast<const char*>(mapping + header->arena_offset);
+	return true;
+}
+
+template<typename key, typename value>
+void hashtable_view<key, value>::close()
+{
+#if defined(_WIN32)
+	if (mapping) UnmapViewOfFile(mapping);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle != INVALID_HANDLE_VALUE) CloseHandle(file_handle);
+	mapping_handle = nullptr;
+	file_handle = INVALID_HANDLE_VALUE;
+#else
+	if (mapping) munmap(const_cast<unsigned char*>(mapping), mapping_size);
+#endif
+
+	mapping = nullptr;
+	mapping_size = 0;
+	header = nullptr;
+	control = nullptr;
+	slots = nullptr;
+	arena = nullptr;
+}
+
+template<typename key, typename value>
+inline bool hashtable_view<key, value>::is_open() const
+{
+	return mapping != nullptr;
+}
+
+template<typename key, typename value>
+bool hashtable_view<key, value>::validate() const
+{
+	if (mapping_size < sizeof(snapshot_header) ||
+		std::memcmp(header->magic, snapshot_magic, sizeof(snapshot_magic)) != 0 ||
+		header->version != snapshot_version ||
+		header->key_size != key_traits::stored_size ||
+		header->value_size != value_traits::stored_size ||
+		header->slot_size < sizeof(uint64_t) + header->key_size + header->value_size)
+	{
+		return false;
+	}
+
+	// a power-of-two slot count that fits in the file before the arena; the
+	// contents of the slots themselves are trusted, snapshots are our own files
+	return header->slot_count != 0 && header->number_of_pairs < header->slot_count && (header->slot_count & (header->slot_count - 1)) == 0 &&
+		header->control_offset + header->slot_count <= header->slots_offset &&
+		header->slots_offset + header->slot_count * header->slot_size <= header->arena_offset &&
+		header->arena_offset + header->arena_size <= mapping_size;
+}
+
+
+template<typename key, typename value>
+const unsigned char* hashtable_view<key, value>::lookup(const key_view& current_key) const
+{
+	if (mapping == nullptr)
+	{
+		return nullptr;
+	}
+
+	uint64_t hash_code = key_traits::hash(current_key);
+	unsigned char fragment = static_cast<unsigned char>(0x80 | (hash_code >> 57));
+	size_t mask = header->slot_count - 1;
+
+	for (size_t index = hash_code & mask; control[index] != 0; index = (index + 1) & mask)
+	{
+		if (control[index] != fragment)
+		{
+			continue;
+		}
+
+		const unsigned char* slot = slots + index * header->slot_size;
+		uint64_t stored_hash;
+		std::memcpy(&stored_hash, slot, sizeof(stored_hash));
+
+		if (stored_hash == hash_code && key_traits::load(slot + sizeof(uint64_t), arena) == current_key)
+		{
+			return slot;
+		}
+	}
+	return nullptr;
+}
+
+template<typename key, typename value>
+inline bool hashtable_view<key, value>::find(const key_view& current_key) const
+{
+	return lookup(current_key) != nullptr;
+}
+
+template<typename key, typename value>
+inline typename hashtable_view<key, value>::value_view hashtable_view<key, value>::get_value(const key_view& current_key) const
+{
+	const unsigned char* slot = lookup(current_key);
+
+	if (slot)
+	{
+		return value_traits::load(slot + sizeof(uint64_t) + key_traits::stored_size, arena);
+	}
+	return value_view();
+}
+
+template<typename key, typename value>
+inline size_t hashtable_view<key, value>::size() const
+{
+	return header ? static_cast<size_t>(header->number_of_pairs) : 0;
+}
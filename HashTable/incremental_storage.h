@@ -0,0 +1,438 @@
+#pragma once
+#include <iostream>
+#include <algorithm>
+#include <list>
+#include <utility>
+#include "chained_storage.h"
+#include "control_group.h"
+#include "hash_functions.h"
+#include "table_stats.h"
+
+
+// Chained layout that never rehashes in one go. Growing only allocates the new
+// bucket array, without constructing its buckets; the old one stays alive next
+// to it and every lookup or erase moves a few of its buckets over
+// (std::list::splice, no allocation). Fibonacci indexing keeps the top bits of
+// the hash, so old bucket i splits into new buckets [i * ratio, (i + 1) * ratio)
+// and those are constructed just as bucket i is moved. Until migration is done
+// a pair lives in its old bucket if that has not been moved yet, in its new
+// bucket otherwise.
+template<typename key, typename value, typename hash, typename allocator>
+class incremental_storage
+{
+public:
+	using pair_type = std::pair<key, value>;
+	using bucket_type = std::list<pair_type, typename std::allocator_traits<allocator>::template rebind_alloc<pair_type>>;
+
+private:
+	typename bucket_type::allocator_type alloc;
+	bucket_type* arr;
+	size_t arr_length;
+	unsigned arr_shift;
+	bucket_type* old_arr;
+	size_t old_arr_length;
+	unsigned old_arr_shift;
+	size_t migrate_position;
+	size_t number_of_pairs;
+	hash hasher;
+
+	// buckets moved per operation; two or more keeps migration ahead of the
+	// inserts needed to trigger the next growth
+	static constexpr size_t migrate_step = 4;
+
+	bucket_type& bucket_of(size_t hash_code);
+	size_t constructed_buckets() const;
+	void migrate(size_t buckets);
+	void start_migration(size_t new_length);
+	void init(const incremental_storage& other);
+	void release();
+public:
+	explicit incremental_storage(const allocator& alloc = allocator());
+	incremental_storage(const incremental_storage& other);
+	incremental_storage& operator=(const incremental_storage& other);
+	~incremental_storage();
+
+	template<typename lookup_key>
+	size_t hash_code(const lookup_key& current_key);
+	template<typename lookup_key>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code);
+	template<typename lookup_key, typename counter>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code, counter& probes);
+	template<typename... args>
+	pair_type* emplace(size_t hash_code, args&&... arguments);
+	template<typename lookup_key>
+	bool erase(const lookup_key& current_key, size_t hash_code);
+
+	bool needs_rehash();
+	void rehash();
+	void reserve(size_t pairs);
+	void prefetch(size_t hash_code);
+	bool migrating();
+
+	float load_factor();
+	size_t size();
+	size_t bucket_count();
+	size_t max_chain_length();
+	void print();
+	template<typename function_type>
+	void for_each(function_type function);
+};
+
+
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline incremental_storage<key, value, hash, allocator>::incremental_storage(const allocator& alloc) : alloc(alloc)
+{
+	number_of_pairs = 0;
+	arr_length = 8;
+	arr_shift = fibonacci_shift(arr_length);
+	arr = new_buckets<bucket_type>(arr_length, this->alloc);
+	old_arr = nullptr;
+	old_arr_length = 0;
+	old_arr_shift = 0;
+	migrate_position = 0;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline incremental_storage<key, value, hash, allocator>::incremental_storage(const incremental_storage& other) :
+	alloc(std::allocator_traits<typename bucket_type::allocator_type>::select_on_container_copy_construction(other.alloc))
+{
+	init(other);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline incremental_storage<key, value, hash, allocator>& incremental_storage<key, value, hash, allocator>::operator=(const incremental_storage& other)
+{
+	if (this != &other)
+	{
+		release();
+		init(other);
+	}
+
+	return *this;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline incremental_storage<key, value, hash, allocator>::~incremental_storage()
+{
+	release();
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline size_t incremental_storage<key, value, hash, allocator>::hash_code(const lookup_key& current_key)
+{
+	return hasher(current_key);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline typename incremental_storage<key, value, hash, allocator>::pair_type* incremental_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code)
+{
+	null_counter probes;
+	return lookup(current_key, hash_code, probes);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key, typename counter>
+inline typename incremental_storage<key, value, hash, allocator>::pair_type* incremental_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code, counter& probes)
+{
+	migrate(migrate_step);
+
+	bucket_type& bucket = bucket_of(hash_code);
+	for (auto itr = bucket.begin(); itr != bucket.end(); itr++)
+	{
+		++probes;
+		if (itr->first == current_key)
+		{
+			return &(*itr);
+		}
+	}
+	return nullptr;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename... args>
+inline typename incremental_storage<key, value, hash, allocator>::pair_type* incremental_storage<key, value, hash, allocator>::emplace(size_t hash_code, args&&... arguments)
+{
+	bucket_type& bucket = bucket_of(hash_code);
+
+	++number_of_pairs;
+	bucket.emplace_back(std::forward<args>(arguments)...);
+	return &(*bucket.rbegin());
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline bool incremental_storage<key, value, hash, allocator>::erase(const lookup_key& current_key, size_t hash_code)
+{
+	migrate(migrate_step);
+
+	bucket_type& bucket = bucket_of(hash_code);
+	for (auto itr = bucket.begin(); itr != bucket.end(); itr++)
+	{
+		if (itr->first == current_key)
+		{
+			bucket.erase(itr);
+			--number_of_pairs;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline bool incremental_storage<key, value, hash, allocator>::needs_rehash()
+{
+	return number_of_pairs + 1 > arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::rehash()
+{
+	// growing again before the last migration is done would mean finishing it
+	// in one go; push it along by another step instead and grow once it is over
+	if (old_arr)
+	{
+		migrate(migrate_step);
+		return;
+	}
+
+	start_migration(arr_length * 2);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::reserve(size_t pairs)
+{
+	size_t new_length = arr_length;
+	while (pairs + 1 > new_length)
+	{
+		new_length *= 2;
+	}
+
+	if (new_length != arr_length)
+	{
+		// an explicit reserve is a bulk-load path, so it migrates everything now
+		// instead of leaving a huge old array for later operations to drain
+		migrate(old_arr_length);
+		start_migration(new_length);
+		migrate(old_arr_length);
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::start_migration(size_t new_length)
+{
+	// callers finish the previous migration first
+	old_arr = arr;
+	old_arr_length = arr_length;
+	old_arr_shift = arr_shift;
+	migrate_position = 0;
+
+	arr_length = new_length;
+	arr_shift = fibonacci_shift(arr_length);
+	arr = static_cast<bucket_type*>(::operator new(sizeof(bucket_type) * arr_length));
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::prefetch(size_t hash_code)
+{
+	prefetch_address(&bucket_of(hash_code));
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline bool incremental_storage<key, value, hash, allocator>::migrating()
+{
+	return old_arr != nullptr;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline typename incremental_storage<key, value, hash, allocator>::bucket_type& incremental_storage<key, value, hash, allocator>::bucket_of(size_t hash_code)
+{
+	if (old_arr)
+	{
+		size_t old_index = fibonacci_index(hash_code, old_arr_shift);
+		if (old_index >= migrate_position)
+		{
+			return old_arr[old_index];
+		}
+	}
+	return arr[fibonacci_index(hash_code, arr_shift)];
+}
+
+// buckets of arr constructed so far: all of them unless a migration is running
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t incremental_storage<key, value, hash, allocator>::constructed_buckets() const
+{
+	return old_arr ? migrate_position * (arr_length / old_arr_length) : arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::migrate(size_t buckets)
+{
+	if (old_arr == nullptr) return;
+
+	size_t ratio = arr_length / old_arr_length;
+	for (; buckets > 0 && migrate_position < old_arr_length; --buckets, ++migrate_position)
+	{
+		for (size_t index = migrate_position * ratio; index < (migrate_position + 1) * ratio; ++index)
+		{
+			new (arr + index) bucket_type(alloc);
+		}
+
+		bucket_type& old_bucket = old_arr[migrate_position];
+		while (!old_bucket.empty())
+		{
+			bucket_type& bucket = arr[fibonacci_index(hasher(old_bucket.front().first), arr_shift)];
+			bucket.splice(bucket.end(), old_bucket, old_bucket.begin());
+		}
+		old_bucket.~bucket_type();
+	}
+
+	if (migrate_position == old_arr_length)
+	{
+		// every old bucket has been destroyed as it was moved
+		::operator delete(old_arr);
+		old_arr = nullptr;
+		old_arr_length = 0;
+		migrate_position = 0;
+	}
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline float incremental_storage<key, value, hash, allocator>::load_factor()
+{
+	return static_cast<float>(number_of_pairs) / arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t incremental_storage<key, value, hash, allocator>::size()
+{
+	return number_of_pairs;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t incremental_storage<key, value, hash, allocator>::bucket_count()
+{
+	return arr_length;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename function_type>
+inline void incremental_storage<key, value, hash, allocator>::for_each(function_type function)
+{
+	for (size_t index = 0; index < constructed_buckets(); ++index)
+	{
+		for (const pair_type& pair : arr[index])
+		{
+			function(pair);
+		}
+	}
+
+	if (old_arr)
+	{
+		for (size_t index = migrate_position; index < old_arr_length; ++index)
+		{
+			for (const pair_type& pair : old_arr[index])
+			{
+				function(pair);
+			}
+		}
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t incremental_storage<key, value, hash, allocator>::max_chain_length()
+{
+	size_t longest = 0;
+	for (size_t index = 0; index < constructed_buckets(); ++index)
+	{
+		longest = std::max(longest, arr[index].size());
+	}
+	for (size_t index = migrate_position; index < old_arr_length; ++index)
+	{
+		longest = std::max(longest, old_arr[index].size());
+	}
+	return longest;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::print()
+{
+	for (size_t index = 0; index < constructed_buckets(); ++index)
+	{
+		std::cout << index << " : ";
+
+		for (const pair_type& pair : arr[index])
+		{
+			std::cout << "{" << pair.first << ", " << pair.second << "} ";
+		}
+		std::cout << "\n";
+	}
+
+	if (old_arr)
+	{
+		std::cout << "migrating, " << old_arr_length - migrate_position << " old buckets left\n";
+
+		for (size_t index = migrate_position; index < old_arr_length; ++index)
+		{
+			std::cout << "old " << index << " : ";
+
+			for (const pair_type& pair : old_arr[index])
+			{
+				std::cout << "{" << pair.first << ", " << pair.second << "} ";
+			}
+			std::cout << "\n";
+		}
+	}
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::init(const incremental_storage& other)
+{
+	arr_length = other.arr_length;
+	arr_shift = other.arr_shift;
+	number_of_pairs = other.number_of_pairs;
+	hasher = other.hasher;
+	arr = new_buckets<bucket_type>(arr_length, this->alloc);
+	for (size_t index = 0; index < other.constructed_buckets(); ++index)
+	{
+		arr[index] = other.arr[index];
+	}
+
+	old_arr = nullptr;
+	old_arr_length = 0;
+	old_arr_shift = 0;
+	migrate_position = 0;
+
+	// the copy does not inherit the migration, it places the pending pairs directly
+	if (other.old_arr)
+	{
+		for (size_t index = other.migrate_position; index < other.old_arr_length; ++index)
+		{
+			for (const pair_type& pair : other.old_arr[index])
+			{
+				arr[fibonacci_index(hasher(pair.first), arr_shift)].push_back(pair);
+			}
+		}
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void incremental_storage<key, value, hash, allocator>::release()
+{
+	delete_buckets(arr, constructed_buckets());
+	if (old_arr)
+	{
+		for (size_t index = migrate_position; index < old_arr_length; ++index)
+		{
+			old_arr[index].~bucket_type();
+		}
+		::operator delete(old_arr);
+	}
+}
@@ -0,0 +1,443 @@
+#pragma once
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <utility>
+#include "control_group.h"
+#include "hash_functions.h"
+#include "table_stats.h"
+
+
+// Flat layout: keys and values live in one contiguous slot array, with a
+// parallel array of control bytes split into groups of 16. A lookup scans a
+// whole group at once for the 7-bit hash fragment and compares full keys only
+// on fragment hits; it stops at the first group that still has an empty slot.
+// Erased slots become tombstones so that probe chains running through them
+// stay intact; they are dropped on the next rehash.
+template<typename key, typename value, typename hash, typename allocator>
+class open_addressing_storage
+{
+public:
+	using pair_type = std::pair<key, value>;
+
+private:
+	// one array allocation per rehash, so a node pool has nothing to add here,
+	// but a custom allocator still gets to place the slots
+	using slot_allocator = typename std::allocator_traits<allocator>::template rebind_alloc<pair_type>;
+
+	slot_allocator alloc;
+	pair_type* slots;
+	control_group* groups;
+	size_t capacity;
+	size_t number_of_pairs;
+	size_t number_of_tombstones;
+	hash hasher;
+
+	static constexpr size_t min_capacity = control_group::width;
+
+	// hash_code >> probe_shift is the top log2(group_count()) + 7 bits of the
+	// hash: the group index above the 7-bit fragment
+	unsigned probe_shift;
+
+	size_t group_index(size_t hash_code) { return hash_code >> probe_shift >> 7; }
+	int8_t fragment(size_t hash_code) { return static_cast<int8_t>((hash_code >> probe_shift) & 0x7f); }
+
+	size_t group_count();
+	int8_t& control(size_t index);
+	size_t find_free_slot(size_t hash_code);
+	void allocate(size_t new_capacity);
+	void release();
+	void init(const open_addressing_storage& other);
+	void rehash(size_t new_capacity);
+public:
+	explicit open_addressing_storage(const allocator& alloc = allocator());
+	open_addressing_storage(const open_addressing_storage& other);
+	open_addressing_storage& operator=(const open_addressing_storage& other);
+	~open_addressing_storage();
+
+	template<typename lookup_key>
+	size_t hash_code(const lookup_key& current_key);
+	template<typename lookup_key>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code);
+	template<typename lookup_key, typename counter>
+	pair_type* lookup(const lookup_key& current_key, size_t hash_code, counter& probes);
+	template<typename... args>
+	pair_type* emplace(size_t hash_code, args&&... arguments);
+	template<typename lookup_key>
+	bool erase(const lookup_key& current_key, size_t hash_code);
+
+	bool needs_rehash();
+	void rehash();
+	void reserve(size_t pairs);
+	void prefetch(size_t hash_code);
+
+	float load_factor();
+	size_t size();
+	size_t bucket_count();
+	size_t max_chain_length();
+	void print();
+	template<typename function_type>
+	void for_each(function_type function);
+};
+
+
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline open_addressing_storage<key, value, hash, allocator>::open_addressing_storage(const allocator& alloc) : alloc(alloc)
+{
+	allocate(min_capacity);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline open_addressing_storage<key, value, hash, allocator>::open_addressing_storage(const open_addressing_storage& other) :
+	alloc(std::allocator_traits<slot_allocator>::select_on_container_copy_construction(other.alloc))
+{
+	init(other);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline open_addressing_storage<key, value, hash, allocator>& open_addressing_storage<key, value, hash, allocator>::operator=(const open_addressing_storage& other)
+{
+	if (this != &other)
+	{
+		release();
+		init(other);
+	}
+
+	return *this;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline open_addressing_storage<key, value, hash, allocator>::~open_addressing_storage()
+{
+	release();
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline size_t open_addressing_storage<key, value, hash, allocator>::hash_code(const lookup_key& current_key)
+{
+	// identity hashes (std::hash of integers) would put runs of consecutive
+	// keys into the same group; one multiply spreads them over the high bits,
+	// which is where group_index and fragment read from
+	return hasher(current_key) * static_cast<size_t>(0x9E3779B97F4A7C15ull);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline typename open_addressing_storage<key, value, hash, allocator>::pair_type* open_addressing_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code)
+{
+	null_counter probes;
+	return lookup(current_key, hash_code, probes);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key, typename counter>
+inline typename open_addressing_storage<key, value, hash, allocator>::pair_type* open_addressing_storage<key, value, hash, allocator>::lookup(const lookup_key& current_key, size_t hash_code, counter& probes)
+{
+	size_t mask = group_count() - 1;
+	size_t current_group = group_index(hash_code) & mask;
+
+	for (size_t step = 1; ; ++step)
+	{
+		const control_group& group = groups[current_group];
+		++probes;
+
+		for (group_mask match = group.match(fragment(hash_code)); match.any(); match.pop_lowest())
+		{
+			size_t index = current_group * control_group::width + match.lowest();
+
+			if (slots[index].first == current_key)
+			{
+				return slots + index;
+			}
+		}
+
+		if (group.match_empty().any())
+		{
+			return nullptr;
+		}
+		current_group = (current_group + step) & mask;
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename... args>
+inline typename open_addressing_storage<key, value, hash, allocator>::pair_type* open_addressing_storage<key, value, hash, allocator>::emplace(size_t hash_code, args&&... arguments)
+{
+	size_t index = find_free_slot(hash_code);
+
+	if (control(index) == control_deleted)
+	{
+		--number_of_tombstones;
+	}
+
+	new (slots + index) pair_type(std::forward<args>(arguments)...);
+	control(index) = fragment(hash_code);
+	++number_of_pairs;
+	return slots + index;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename lookup_key>
+inline bool open_addressing_storage<key, value, hash, allocator>::erase(const lookup_key& current_key, size_t hash_code)
+{
+	pair_type* pair = lookup(current_key, hash_code);
+
+	if (pair == nullptr)
+	{
+		return false;
+	}
+
+	size_t index = pair - slots;
+	pair->~pair_type();
+
+	// a group that still has an empty slot has never been full, so no probe
+	// chain continues past it and the slot can go straight back to empty
+	if (groups[index / control_group::width].match_empty().any())
+	{
+		control(index) = control_empty;
+	}
+	else
+	{
+		control(index) = control_deleted;
+		++number_of_tombstones;
+	}
+	--number_of_pairs;
+	return true;
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline bool open_addressing_storage<key, value, hash, allocator>::needs_rehash()
+{
+	// group probing stays cheap up to 7/8 full, tombstones included
+	return (number_of_pairs + number_of_tombstones + 1) * 8 > capacity * 7;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::rehash()
+{
+	// mostly tombstones: clean up in place instead of growing
+	if ((number_of_pairs + 1) * 2 <= capacity)
+	{
+		rehash(capacity);
+	}
+	else
+	{
+		rehash(capacity * 2);
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::reserve(size_t pairs)
+{
+	size_t new_capacity = capacity;
+	while ((pairs + 1) * 8 > new_capacity * 7)
+	{
+		new_capacity *= 2;
+	}
+
+	if (new_capacity != capacity)
+	{
+		rehash(new_capacity);
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::prefetch(size_t hash_code)
+{
+	size_t current_group = group_index(hash_code) & (group_count() - 1);
+
+	prefetch_address(groups + current_group);
+	prefetch_address(slots + current_group * control_group::width);
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::rehash(size_t new_capacity)
+{
+	pair_type* old_slots = slots;
+	control_group* old_groups = groups;
+	size_t old_capacity = capacity;
+
+	allocate(new_capacity);
+
+	for (size_t index = 0; index < old_capacity; ++index)
+	{
+		if (old_groups[index / control_group::width].control[index % control_group::width] >= 0)
+		{
+			size_t hash_code = this->hash_code(old_slots[index].first);
+			size_t new_index = find_free_slot(hash_code);
+
+			new (slots + new_index) pair_type(std::move(old_slots[index]));
+			control(new_index) = fragment(hash_code);
+			++number_of_pairs;
+
+			old_slots[index].~pair_type();
+		}
+	}
+
+	std::allocator_traits<slot_allocator>::deallocate(alloc, old_slots, old_capacity);
+	delete[] old_groups;
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline float open_addressing_storage<key, value, hash, allocator>::load_factor()
+{
+	return static_cast<float>(number_of_pairs) / capacity;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t open_addressing_storage<key, value, hash, allocator>::size()
+{
+	return number_of_pairs;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t open_addressing_storage<key, value, hash, allocator>::bucket_count()
+{
+	return capacity;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+template<typename function_type>
+inline void open_addressing_storage<key, value, hash, allocator>::for_each(function_type function)
+{
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		if (control(index) >= 0)
+		{
+			function(slots[index]);
+		}
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t open_addressing_storage<key, value, hash, allocator>::max_chain_length()
+{
+	// longest probe sequence, in groups, needed to reach any stored pair
+	size_t mask = group_count() - 1;
+	size_t longest = 0;
+
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		if (control(index) < 0) continue;
+
+		size_t hash_code = this->hash_code(slots[index].first);
+		size_t current_group = group_index(hash_code) & mask;
+		size_t length = 1;
+
+		for (size_t step = 1; current_group != index / control_group::width; ++step, ++length)
+		{
+			current_group = (current_group + step) & mask;
+		}
+		longest = std::max(longest, length);
+	}
+	return longest;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::print()
+{
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		std::cout << index << " : ";
+
+		if (control(index) >= 0)
+		{
+			std::cout << "{" << slots[index].first << ", " << slots[index].second << "}";
+		}
+		else if (control(index) == control_deleted)
+		{
+			std::cout << "<deleted>";
+		}
+		std::cout << "\n";
+	}
+}
+
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t open_addressing_storage<key, value, hash, allocator>::group_count()
+{
+	return capacity / control_group::width;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline int8_t& open_addressing_storage<key, value, hash, allocator>::control(size_t index)
+{
+	return groups[index / control_group::width].control[index % control_group::width];
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline size_t open_addressing_storage<key, value, hash, allocator>::find_free_slot(size_t hash_code)
+{
+	size_t mask = group_count() - 1;
+	size_t current_group = group_index(hash_code) & mask;
+
+	for (size_t step = 1; ; ++step)
+	{
+		group_mask free = groups[current_group].match_empty_or_deleted();
+
+		if (free.any())
+		{
+			return current_group * control_group::width + free.lowest();
+		}
+		current_group = (current_group + step) & mask;
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::allocate(size_t new_capacity)
+{
+	capacity = new_capacity;
+	number_of_pairs = 0;
+	number_of_tombstones = 0;
+	slots = std::allocator_traits<slot_allocator>::allocate(alloc, capacity);
+	groups = new control_group[group_count()];
+	probe_shift = fibonacci_shift(group_count()) - 7;
+
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		control(index) = control_empty;
+	}
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::release()
+{
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		if (control(index) >= 0)
+		{
+			slots[index].~pair_type();
+		}
+	}
+
+	std::allocator_traits<slot_allocator>::deallocate(alloc, slots, capacity);
+	delete[] groups;
+}
+
+template<typename key, typename value, typename hash, typename allocator>
+inline void open_addressing_storage<key, value, hash, allocator>::init(const open_addressing_storage& other)
+{
+	allocate(other.capacity);
+	hasher = other.hasher;
+
+	for (size_t index = 0; index < capacity; ++index)
+	{
+		if (other.groups[index / control_group::width].control[index % control_group::width] >= 0)
+		{
+			new (slots + index) pair_type(other.slots[index]);
+		}
+	}
+	for (size_t index = 0; index < group_count(); ++index)
+	{
+		groups[index] = other.groups[index];
+	}
+	number_of_pairs = other.number_of_pairs;
+	number_of_tombstones = other.number_of_tombstones;
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+// Statistics policies for hashtable. The table calls the same hooks on either
+// one; no_stats makes every hook an empty inline function and its probe counter
+// an empty object, so a table built without statistics compiles to the same
+// code as before.
+
+// Probe counter handed to a storage engine's lookup: incremented once per node
+// (chained layouts) or per 16-slot group (open addressing) examined.
+struct null_counter
+{
+	void operator++() {}
+};
+
+struct probe_counter
+{
+	size_t probes = 0;
+	void operator++() { ++probes; }
+};
+
+
+// Point-in-time view of a table, as returned by hashtable::statistics().
+struct hashtable_stats
+{
+	static constexpr size_t histogram_size = 16;
+
+	size_t size = 0;
+	size_t bucket_count = 0;
+	float load_factor = 0;
+	size_t max_chain_length = 0;		// longest chain, or longest probe sequence in groups
+
+	// only filled in by table_stats
+	bool enabled = false;
+	uint64_t lookups = 0;
+	uint64_t probe_histogram[histogram_size] = {};	// last entry counts everything longer
+	uint64_t rehash_count = 0;
+	uint64_t rehash_nanoseconds = 0;
+
+	double average_probe_length() const;
+	std::string to_json() const;
+};
+
+
+struct no_stats
+{
+	using counter = null_counter;
+
+	void record_lookup(const counter&) {}
+	void start_rehash() {}
+	void end_rehash() {}
+	void fill(hashtable_stats&) const {}
+};
+
+class table_stats
+{
+public:
+	using counter = probe_counter;
+
+private:
+	uint64_t lookups = 0;
+	uint64_t probe_histogram[hashtable_stats::histogram_size] = {};
+	uint64_t rehash_count = 0;
+	uint64_t rehash_nanoseconds = 0;
+	std::chrono::steady_clock::time_point rehash_started;
+
+public:
+	void record_lookup(const counter& probes);
+	void start_rehash();
+	void end_rehash();
+	void fill(hashtable_stats& stats) const;
+};
+
+
+
+
+inline double hashtable_stats::average_probe_length() const
+{
+	if (lookups == 0)
+	{
+		return 0;
+	}
+
+	uint64_t total = 0;
+	for (size_t index = 0; index < histogram_size; ++index)
+	{
+		total += probe_histogram[index] * index;
+	}
+	return static_cast<double>(total) / lookups;
+}
+
+inline std::string hashtable_stats::to_json() const
+{
+	std::string json = "{";
+	json += "\"size\":" + std::to_string(size);
+	json += ",\"bucket_count\":" + std::to_string(bucket_count);
+	json += ",\"load_factor\":" + std::to_string(load_factor);
+	json += ",\"max_chain_length\":" + std::to_string(max_chain_length);
+	json += ",\"enabled\":" + std::string(enabled ? "true" : "false");
+
+	if (enabled)
+	{
+		json += ",\"lookups\":" + std::to_string(lookups);
+		json += ",\"average_probe_length\":" + std::to_string(average_probe_length());
+		json += ",\"probe_histogram\":[";
+		for (size_t index = 0; index < histogram_size; ++index)
+		{
+			json += (index ? "," : "") + std::to_string(probe_histogram[index]);
+		}
+		json += "]";
+		json += ",\"rehash_count\":" + std::to_string(rehash_count);
+		json += ",\"rehash_nanoseconds\":" + std::to_string(rehash_nanoseconds);
+	}
+	return json + "}";
+}
+
+
+inline void table_stats::record_lookup(const counter& probes)
+{
+	++lookups;
+	++probe_histogram[probes.probes < hashtable_stats::histogram_size ? probes.probes : hashtable_stats::histogram_size - 1];
+}
+
+inline void table_stats::start_rehash()
+{
+	rehash_started = std::chrono::steady_clock::now();
+}
+
+inline void table_stats::end_rehash()
+{
+	++rehash_count;
+	rehash_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - rehash_started).count();
+}
+
+inline void table_stats::fill(hashtable_stats& stats) const
+{
+	stats.enabled = true;
+	stats.lookups = lookups;
+	for (size_t index = 0; index < hashtable_stats::histogram_size; ++index)
+	{
+		stats.probe_histogram[index] = probe_histogram[index];
+	}
+	stats.rehash_count = rehash_count;
+	stats.rehash_nanoseconds = rehash_nanoseconds;
+}
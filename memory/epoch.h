@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+
+
+// Epoch-based memory reclamation for the lock-free readers of the concurrent
+// containers. A reader pins the current epoch with an epoch_guard for as long
+// as it dereferences shared nodes; a writer that unlinks a node hands it to
+// retire() instead of deleting it. The global epoch only moves forward once
+// every pinned thread has seen it, so anything retired two epochs ago can no
+// longer be reached by any reader and is freed.
+class epoch_domain
+{
+public:
+	// Most threads that can use the domain at once: a thread takes a slot at
+	// its first pin and keeps it until it exits, and a thread that pins while
+	// all of them are taken aborts the process.
+	static constexpr size_t max_threads = 256;
+
+	class guard
+	{
+	public:
+		guard();
+		~guard();
+		guard(const guard&) = delete;
+		guard& operator=(const guard&) = delete;
+	};
+
+	static epoch_domain& global();
+
+	void retire(void* pointer, void (*deleter)(void*));
+	template<typename T>
+	void retire(T* pointer);
+
+	void collect();
+
+	~epoch_domain();
+
+private:
+	struct alignas(64) thread_slot
+	{
+		std::atomic<uint64_t> epoch{ 0 };	// 0 while the thread is not pinned
+		std::atomic<bool> in_use{ false };
+	};
+
+	struct retired_pointer
+	{
+		void* pointer;
+		void (*deleter)(void*);
+		uint64_t epoch;
+	};
+
+	// claims a slot the first time a thread pins and gives it back on thread exit
+	struct thread_record
+	{
+		size_t slot;
+		size_t depth;
+		thread_record();
+		~thread_record();
+	};
+
+	static constexpr size_t collect_interval = 64;
+
+	std::atomic<uint64_t> global_epoch{ 1 };
+	thread_slot slots[max_threads];
+	std::mutex retired_lock;
+	std::vector<retired_pointer> retired;
+	size_t retired_since_collect = 0;
+
+	epoch_domain() = default;
+
+	static thread_record& current_thread();
+	bool try_advance();
+};
+
+using epoch_guard = epoch_domain::guard;
+
+
+
+
+inline epoch_domain& epoch_domain::global()
+{
+	static epoch_domain domain;
+	return domain;
+}
+
+inline epoch_domain::thread_record::thread_record() : slot(0), depth(0)
+{
+	epoch_domain& domain = global();
+
+	for (; slot < max_threads; ++slot)
+	{
+		bool expected = false;
+		if (!domain.slots[slot].in_use.load(std::memory_order_relaxed) &&
+			domain.slots[slot].in_use.compare_exchange_strong(expected, true))
+		{
+			return;
+		}
+	}
+
+	// waiting for a slot to free up could hang forever, and running without
+	// one would let writers free nodes this thread still reads
+	std::fprintf(stderr, "epoch_domain: more than %zu threads hold an epoch slot\n", max_threads);
+	std::abort();
+}
+
+inline epoch_domain::thread_record::~thread_record()
+{
+	epoch_domain& domain = global();
+	domain.slots[slot].epoch.store(0, std::memory_order_release);
+	domain.slots[slot].in_use.store(false, std::memory_order_release);
+}
+
+inline epoch_domain::thread_record& epoch_domain::current_thread()
+{
+	thread_local thread_record record;
+	return record;
+}
+
+
+inline epoch_domain::guard::guard()
+{
+	thread_record& record = current_thread();
+
+	if (record.depth++ == 0)
+	{
+		epoch_domain& domain = global();
+		// seq_cst so that the pin is visible before any shared pointer is read
+		domain.slots[record.slot].epoch.store(domain.global_epoch.load());
+	}
+}
+
+inline epoch_domain::guard::~guard()
+{
+	thread_record& record = current_thread();
+
+	if (--record.depth == 0)
+	{
+		global().slots[record.slot].epoch.store(0, std::memory_order_release);
+	}
+}
+
+
+inline void epoch_domain::retire(void* pointer, void (*deleter)(void*))
+{
+	bool should_collect;
+	{
+		std::lock_guard<std::mutex> lock(retired_lock);
+		retired.push_back({ pointer, deleter, global_epoch.load() });
+		should_collect = ++retired_since_collect >= collect_interval;
+	}
+
+	if (should_collect)
+	{
+		collect();
+	}
+}
+
+template<typename T>
+inline void epoch_domain::retire(T* pointer)
+{
+	retire(pointer, [](void* p) { delete static_cast<T*>(p); });
+}
+
+inline bool epoch_domain::try_advance()
+{
+	uint64_t epoch = global_epoch.load();
+
+	for (thread_slot& slot : slots)
+	{
+		uint64_t pinned = slot.epoch.load();
+		if (pinned != 0 && pinned != epoch)
+		{
+			return false;
+		}
+	}
+	return global_epoch.compare_exchange_strong(epoch, epoch + 1);
+}
+
+inline void epoch_domain::collect()
+{
+	try_advance();
+
+	std::vector<retired_pointer> reclaimable;
+	{
+		std::lock_guard<std::mutex> lock(retired_lock);
+		uint64_t epoch = global_epoch.load();
+		retired_since_collect = 0;
+
+		size_t kept = 0;
+		for (retired_pointer& pointer : retired)
+		{
+			if (pointer.epoch + 2 <= epoch)
+			{
+				reclaimable.push_back(pointer);
+			}
+			else
+			{
+				retired[kept++] = pointer;
+			}
+		}
+		retired.resize(kept);
+	}
+
+	for (retired_pointer& pointer : reclaimable)
+	{
+		pointer.deleter(pointer.pointer);
+	}
+}
+
+inline epoch_domain::~epoch_domain()
+{
+	for (retired_pointer& pointer : retired)
+	{
+		pointer.deleter(pointer.pointer);
+	}
+}
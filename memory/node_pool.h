@@ -0,0 +1,245 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+
+// Slab allocator for node-based containers. Memory is taken from the system in
+// large slabs and cut into nodes; a freed node goes onto the free list of its
+// size class and is handed out again before the slab is touched. Nodes of one
+// container therefore sit next to each other, allocating one is a pointer bump
+// or a pop, and release() returns every slab at once without visiting a node.
+//
+// A pool is not thread-safe; share one between containers of the same thread only.
+class node_pool
+{
+public:
+	static constexpr size_t granularity = 16;		// node sizes are rounded up to this, also the alignment
+	static constexpr size_t max_node_size = 256;	// anything bigger goes straight to operator new
+
+	explicit node_pool(size_t slab_size = 64 * 1024);
+	~node_pool();
+	node_pool(const node_pool&) = delete;
+	node_pool& operator=(const node_pool&) = delete;
+
+	void* allocate(size_t bytes);
+	void deallocate(void* pointer, size_t bytes);
+
+	// frees every slab; all nodes handed out so far become invalid
+	void release();
+	// takes over the slabs of other, which is left empty: nodes it handed
+	// out now belong to this pool and are freed through it. Costs one step
+	// per slab; other's free nodes are dropped until the slabs go.
+	void merge(node_pool& other);
+
+	size_t reserved_bytes() const;
+
+private:
+	struct free_node
+	{
+		free_node* next;
+	};
+
+	static constexpr size_t size_classes = max_node_size / granularity;
+
+	free_node* free_lists[size_classes];
+	std::vector<void*> slabs;
+	char* slab_position;
+	char* slab_end;
+	size_t slab_size;
+
+	static size_t size_class(size_t bytes) { return (bytes + granularity - 1) / granularity - 1; }
+};
+
+
+// Standard allocator over a shared node_pool. Single objects small enough for
+// the pool come from it, arrays and large objects from operator new, so the
+// allocator can be handed to any container. Rebound copies share the pool.
+// Copying a container does not share it: the copy starts its own pool.
+template<typename T>
+class pool_allocator
+{
+public:
+	using value_type = T;
+	using propagate_on_container_move_assignment = std::true_type;
+	using propagate_on_container_swap = std::true_type;
+
+	std::shared_ptr<node_pool> pool;
+
+	pool_allocator() : pool(std::make_shared<node_pool>()) {}
+	explicit pool_allocator(std::shared_ptr<node_pool> pool) : pool(std::move(pool)) {}
+	template<typename U>
+	pool_allocator(const pool_allocator<U>& other) : pool(other.pool) {}
+
+	T* allocate(size_t count);
+	void deallocate(T* pointer, size_t count);
+
+	pool_allocator select_on_container_copy_construction() const { return pool_allocator(); }
+
+	// single objects of T come from the pool, everything else from operator new
+	static constexpr bool pooled_type = sizeof(T) <= node_pool::max_node_size && alignof(T) <= node_pool::granularity;
+
+	template<typename U>
+	bool operator==(const pool_allocator<U>& other) const { return pool == other.pool; }
+	template<typename U>
+	bool operator!=(const pool_allocator<U>& other) const { return pool != other.pool; }
+};
+
+
+// Lets a container drop all of its nodes in one go when that is safe: the
+// nodes come from the pool (not from operator new, as oversized ones do), the
+// pool belongs to this container alone and the nodes need no destructor.
+// Returns false when the caller still has to destroy the nodes one by one.
+template<typename node_type, typename allocator>
+inline bool release_nodes(allocator&)
+{
+	return false;
+}
+
+template<typename node_type, typename T>
+inline bool release_nodes(pool_allocator<T>& allocator)
+{
+	if (pool_allocator<node_type>::pooled_type && std::is_trivially_destructible<node_type>::value && allocator.pool.use_count() == 1)
+	{
+		allocator.pool->release();
+		return true;
+	}
+	return false;
+}
+
+// Lets a container take over the nodes of another without copying them:
+// true if nodes of from may be freed through to from now on, either because
+// the two share a pool or because the pool of from, used by that container
+// alone, was merged into the pool of to.
+template<typename allocator>
+inline bool merge_nodes(allocator& to, allocator& from)
+{
+	return to == from;
+}
+
+template<typename T>
+inline bool merge_nodes(pool_allocator<T>& to, pool_allocator<T>& from)
+{
+	if (to == from)
+	{
+		return true;
+	}
+	if (from.pool.use_count() != 1)
+	{
+		return false;
+	}
+	to.pool->merge(*from.pool);
+	return true;
+}
+
+
+
+
+inline node_pool::node_pool(size_t slab_size) : free_lists(), slab_position(nullptr), slab_end(nullptr), slab_size(slab_size) {}
+
+inline node_pool::~node_pool()
+{
+	release();
+}
+
+inline void* node_pool::allocate(size_t bytes)
+{
+	if (bytes > max_node_size)
+	{
+		return ::operator new(bytes);
+	}
+
+	size_t index = size_class(bytes);
+	if (free_lists[index])
+	{
+		free_node* node = free_lists[index];
+		free_lists[index] = node->next;
+		return node;
+	}
+
+	size_t rounded = (index + 1) * granularity;
+	if (static_cast<size_t>(slab_end - slab_position) < rounded)
+	{
+		// operator new memory is aligned for any fundamental type, and every
+		// node size is a multiple of granularity, so nodes stay aligned
+		slab_position = static_cast<char*>(::operator new(slab_size));
+		slab_end = slab_position + slab_size;
+		slabs.push_back(slab_position);
+	}
+
+	void* result = slab_position;
+	slab_position += rounded;
+	return result;
+}
+
+inline void node_pool::deallocate(void* pointer, size_t bytes)
+{
+	if (bytes > max_node_size)
+	{
+		::operator delete(pointer);
+		return;
+	}
+
+	size_t index = size_class(bytes);
+	free_node* node = static_cast<free_node*>(pointer);
+	node->next = free_lists[index];
+	free_lists[index] = node;
+}
+
+inline void node_pool::release()
+{
+	for (void* slab : slabs)
+	{
+		::operator delete(slab);
+	}
+	slabs.clear();
+
+	for (free_node*& list : free_lists)
+	{
+		list = nullptr;
+	}
+	slab_position = slab_end = nullptr;
+}
+
+inline void node_pool::merge(node_pool& other)
+{
+	slabs.insert(slabs.end(), other.slabs.begin(), other.slabs.end());
+	other.slabs.clear();
+
+	for (free_node*& list : other.free_lists)
+	{
+		list = nullptr;
+	}
+	other.slab_position = other.slab_end = nullptr;
+}
+
+inline size_t node_pool::reserved_bytes() const
+{
+	return slabs.size() * slab_size;
+}
+
+
+template<typename T>
+inline T* pool_allocator<T>::allocate(size_t count)
+{
+	if (pooled_type && count == 1)
+	{
+		return static_cast<T*>(pool->allocate(sizeof(T)));
+	}
+	return static_cast<T*>(::operator new(count * sizeof(T)));
+}
+
+template<typename T>
+inline void pool_allocator<T>::deallocate(T* pointer, size_t count)
+{
+	if (pooled_type && count == 1)
+	{
+		pool->deallocate(pointer, sizeof(T));
+	}
+	else
+	{
+		::operator delete(pointer);
+	}
+}
@@ -0,0 +1,80 @@
+// Standalone check of node_pool and pool_allocator:
+//   g++ -std=c++17 -O2 node_pool_test.cpp && ./a.out
+// Every allocation goes through the counting operator new below, so a node
+// that clear() or a destructor forgets shows up as a live allocation.
+#include <array>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "node_pool.h"
+#include "../stl_like map/map.h"
+
+
+static size_t live_allocations = 0;
+
+void* operator new(size_t bytes)
+{
+	++live_allocations;
+	if (void* pointer = std::malloc(bytes ? bytes : 1))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	if (pointer)
+	{
+		--live_allocations;
+		std::free(pointer);
+	}
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
+
+
+// nodes up to max_node_size come from the slabs, bigger ones from operator new;
+// either way clear() and the destructor must give everything back
+template<typename valueT>
+void check_map_releases_nodes(const char* name)
+{
+	using map_type = map<int, valueT, std::less<int>, pool_allocator<std::pair<const int, valueT>>>;
+	size_t before = live_allocations;
+	{
+		map_type some_map;
+		for (int index = 0; index < 1000; ++index)
+		{
+			some_map.insert({ index, valueT() });
+		}
+		some_map.clear();
+		for (int index = 0; index < 1000; ++index)
+		{
+			some_map.insert({ index, valueT() });
+		}
+	}
+	assert(live_allocations == before);
+	std::printf("%s: ok\n", name);
+}
+
+int main()
+{
+	using small_node = std::array<char, 16>;
+	using large_node = std::array<char, 400>;
+
+	static_assert(pool_allocator<small_node>::pooled_type, "small nodes come from the pool");
+	static_assert(!pool_allocator<large_node>::pooled_type, "large nodes come from operator new");
+
+	pool_allocator<large_node> large_allocator;
+	assert(!release_nodes<large_node>(large_allocator));
+	pool_allocator<small_node> small_allocator;
+	assert(release_nodes<small_node>(small_allocator));
+
+	check_map_releases_nodes<small_node>("map with pooled nodes");
+	check_map_releases_nodes<large_node>("map with nodes over max_node_size");
+	return 0;
+}
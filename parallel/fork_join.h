@@ -0,0 +1,40 @@
+#pragma once
+#include <future>
+#include <thread>
+#include <utility>
+
+
+// Recursion depth down to which divide and conquer algorithms fork: enough
+// levels for every hardware thread to get a share, plus one to even out
+// unequal halves. Zero on a single-threaded machine.
+inline int fork_depth()
+{
+	unsigned threads = std::thread::hardware_concurrency();
+	if (threads <= 1)
+	{
+		return 0;
+	}
+
+	int depth = 1;
+	while ((1u << depth) < threads)
+	{
+		++depth;
+	}
+	return depth + 1;
+}
+
+// Runs both tasks, the first on a thread of its own when fork is set.
+template<typename first_task, typename second_task>
+inline void fork_join(bool fork, first_task&& first, second_task&& second)
+{
+	if (!fork)
+	{
+		first();
+		second();
+		return;
+	}
+
+	std::future<void> pending = std::async(std::launch::async, std::forward<first_task>(first));
+	second();
+	pending.get();
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+
+// Stable sort of a random access range on all hardware threads: the range is
+// cut into one chunk per thread, the chunks are sorted side by side, then
+// merged pairwise, each round of merges again in parallel. Small ranges, or a
+// machine with a single thread, go straight to std::stable_sort.
+template<typename iterator, typename compare = std::less<typename std::iterator_traits<iterator>::value_type>>
+void parallel_sort(iterator first, iterator last, compare comparator = compare())
+{
+	static constexpr size_t min_chunk = size_t(1) << 15;
+
+	size_t size = static_cast<size_t>(last - first);
+	size_t chunks = 1;
+	while (chunks * 2 <= std::thread::hardware_concurrency() && size / (chunks * 2) >= min_chunk)
+	{
+		chunks *= 2;
+	}
+
+	if (chunks == 1)
+	{
+		std::stable_sort(first, last, comparator);
+		return;
+	}
+
+	std::vector<iterator> bounds;
+	for (size_t index = 0; index <= chunks; ++index)
+	{
+		bounds.push_back(first + size * index / chunks);
+	}
+
+	std::vector<std::thread> threads;
+	for (size_t index = 0; index < chunks; ++index)
+	{
+		threads.emplace_back([&bounds, &comparator, index] { std::stable_sort(bounds[index], bounds[index + 1], comparator); });
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	for (size_t width = 1; width < chunks; width *= 2)
+	{
+		threads.clear();
+		for (size_t index = 0; index + width < chunks; index += 2 * width)
+		{
+			threads.emplace_back([&bounds, &comparator, index, width] {
+				std::inplace_merge(bounds[index], bounds[index + width], bounds[index + 2 * width], comparator);
+			});
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
@@ -0,0 +1,198 @@
+#pragma once
+#include "addressable_priority_queue.h"
+
+
+template<typename T, typename compare, size_t arity>
+inline void addressable_priority_queue<T, compare, arity>::place(size_t index, entry&& moved)
+{
+	heap[index] = std::move(moved);
+	slots[heap[index].slot].position = index;
+}
+
+template<typename T, typename compare, size_t arity>
+size_t addressable_priority_queue<T, compare, arity>::sift_down(size_t index)
+{
+	size_t size = heap.size();
+	entry moving = std::move(heap[index]);
+
+	while (first_child<arity>(index) < size)
+	{
+		size_t first = first_child<arity>(index);
+		size_t last = first + arity < size ? first + arity : size;
+		size_t index_max = first;
+
+		for (size_t child = first + 1; child < last; ++child)
+		{
+			if (compare()(heap[index_max].element, heap[child].element))
+			{
+				index_max = child;
+			}
+		}
+		if (!compare()(moving.element, heap[index_max].element))
+		{
+			break;
+		}
+
+		place(index, std::move(heap[index_max]));
+		index = index_max;
+	}
+
+	place(index, std::move(moving));
+	return index;
+}
+
+template<typename T, typename compare, size_t arity>
+size_t addressable_priority_queue<T, compare, arity>::sift_up(size_t index)
+{
+	entry moving = std::move(heap[index]);
+
+	while (index != 0 && compare()(heap[parent<arity>(index)].element, moving.element))
+	{
+		place(index, std::move(heap[parent<arity>(index)]));
+		index = parent<arity>(index);
+	}
+
+	place(index, std::move(moving));
+	return index;
+}
+
+template<typename T, typename compare, size_t arity>
+inline void addressable_priority_queue<T, compare, arity>::release(size_t slot)
+{
+	slots[slot].position = npos;
+	++slots[slot].generation;
+	free_slots.push_back(slot);
+}
+
+template<typename T, typename compare, size_t arity>
+void addressable_priority_queue<T, compare, arity>::remove_at(size_t index)
+{
+	release(heap[index].slot);
+
+	if (index + 1 == heap.size())
+	{
+		heap.pop_back();
+		return;
+	}
+
+	heap[index] = std::move(heap.back());
+	heap.pop_back();
+	slots[heap[index].slot].position = index;
+
+	// the last element may belong above or below the gap
+	if (sift_up(index) == index)
+	{
+		sift_down(index);
+	}
+}
+
+
+template<typename T, typename compare, size_t arity>
+typename addressable_priority_queue<T, compare, arity>::handle addressable_priority_queue<T, compare, arity>::push(T element)
+{
+	size_t slot;
+	if (free_slots.empty())
+	{
+		slot = slots.size();
+		slots.push_back({ npos, 0 });
+	}
+	else
+	{
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+
+	heap.push_back({ std::move(element), slot });
+	slots[slot].position = heap.size() - 1;
+	sift_up(heap.size() - 1);
+
+	return { slot, slots[slot].generation };
+}
+
+template<typename T, typename compare, size_t arity>
+inline const T& addressable_priority_queue<T, compare, arity>::top() const
+{
+	return heap[0].element;
+}
+
+template<typename T, typename compare, size_t arity>
+inline typename addressable_priority_queue<T, compare, arity>::handle addressable_priority_queue<T, compare, arity>::top_handle() const
+{
+	return { heap[0].slot, slots[heap[0].slot].generation };
+}
+
+template<typename T, typename compare, size_t arity>
+inline void addressable_priority_queue<T, compare, arity>::pop()
+{
+	if (!heap.empty())
+	{
+		remove_at(0);
+	}
+}
+
+
+template<typename T, typename compare, size_t arity>
+inline bool addressable_priority_queue<T, compare, arity>::contains(handle current_handle) const
+{
+	return current_handle.slot < slots.size() && slots[current_handle.slot].generation == current_handle.generation &&
+		slots[current_handle.slot].position != npos;
+}
+
+template<typename T, typename compare, size_t arity>
+inline const T& addressable_priority_queue<T, compare, arity>::get(handle current_handle) const
+{
+	return heap[slots[current_handle.slot].position].element;
+}
+
+template<typename T, typename compare, size_t arity>
+bool addressable_priority_queue<T, compare, arity>::update(handle current_handle, T element)
+{
+	if (!contains(current_handle))
+	{
+		return false;
+	}
+
+	size_t index = slots[current_handle.slot].position;
+	heap[index].element = std::move(element);
+	if (sift_up(index) == index)
+	{
+		sift_down(index);
+	}
+	return true;
+}
+
+template<typename T, typename compare, size_t arity>
+bool addressable_priority_queue<T, compare, arity>::erase(handle current_handle)
+{
+	if (!contains(current_handle))
+	{
+		return false;
+	}
+
+	remove_at(slots[current_handle.slot].position);
+	return true;
+}
+
+
+template<typename T, typename compare, size_t arity>
+void addressable_priority_queue<T, compare, arity>::clear()
+{
+	while (!heap.empty())
+	{
+		release(heap.back().slot);
+		heap.pop_back();
+	}
+}
+
+template<typename T, typename compare, size_t arity>
+inline bool addressable_priority_queue<T, compare, arity>::empty() const
+{
+	return heap.empty();
+}
+
+template<typename T, typename compare, size_t arity>
+inline int addressable_priority_queue<T, compare, arity>::size() const
+{
+	return heap.size();
+}
+
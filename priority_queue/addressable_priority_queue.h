@@ -0,0 +1,70 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include "basic_comparators.cpp"
+#include "heap_functions.cpp"
+#include "heap_allocator.cpp"
+
+// Heap whose elements can be reached after they were pushed: push returns a
+// handle, and update and erase find the element through a position map that
+// the sifts keep current, so both are O(log n) and no stale copies pile up.
+//
+// A handle belongs to its element until that is popped or erased. Its slot
+// is then reused, under a new generation, so an old handle is simply no
+// longer contained.
+template <typename T, typename compare = greater<T>, size_t arity = 2>
+class addressable_priority_queue
+{
+	static_assert(arity >= 2, "a heap needs at least two children per node");
+
+public:
+	struct handle
+	{
+		size_t slot;
+		size_t generation;
+	};
+
+private:
+	struct entry
+	{
+		T element;
+		size_t slot;
+	};
+
+	struct slot_state
+	{
+		size_t position;	// index in heap, npos while the slot is free
+		size_t generation;
+	};
+
+	static constexpr size_t npos = static_cast<size_t>(-1);
+
+	std::vector<entry, heap_allocator<entry>> heap;
+	std::vector<slot_state> slots;
+	std::vector<size_t> free_slots;
+
+	// both return where the element ended up
+	size_t sift_down(size_t index);
+	size_t sift_up(size_t index);
+	void place(size_t index, entry&& moved);
+	void release(size_t slot);
+	// takes the element at index out and closes the gap
+	void remove_at(size_t index);
+
+public:
+	handle push(T element);
+	const T& top() const;
+	handle top_handle() const;
+	void pop();
+
+	bool contains(handle current_handle) const;
+	// the element of a contained handle
+	const T& get(handle current_handle) const;
+	// both return false if the handle is no longer contained
+	bool update(handle current_handle, T element);
+	bool erase(handle current_handle);
+
+	void clear();
+	bool empty() const;
+	int size() const;
+};
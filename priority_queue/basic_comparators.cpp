@@ -27,4 +27,9 @@ inline bool greater_or_equal<T>::operator()(T first, T second)
 	return first >= second;
 }
 
+template<class T, class compare>
+inline bool reversed<T, compare>::operator()(T first, T second)
+{
+	return compare()(second, first);
+}
 
@@ -25,3 +25,10 @@ struct greater_or_equal
 	bool operator()(T, T);
 };
 
+// compare with the arguments swapped: the heap it orders pops first what
+// a heap ordered by compare would pop last
+template<class T, class compare>
+struct reversed
+{
+	bool operator()(T, T);
+};
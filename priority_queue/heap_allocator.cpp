@@ -0,0 +1,29 @@
+#pragma once
+#include "heap_allocator.h"
+
+
+template<typename T>
+inline T* heap_allocator<T>::allocate(size_t count)
+{
+	if (!shifted)
+	{
+		return std::allocator<T>().allocate(count);
+	}
+
+	char* line = static_cast<char*>(::operator new(count * sizeof(T) + cache_line, std::align_val_t(cache_line)));
+	return reinterpret_cast<T*>(line + cache_line - sizeof(T));
+}
+
+template<typename T>
+inline void heap_allocator<T>::deallocate(T* pointer, size_t count)
+{
+	if (!shifted)
+	{
+		std::allocator<T>().deallocate(pointer, count);
+		return;
+	}
+
+	char* line = reinterpret_cast<char*>(pointer) + sizeof(T) - cache_line;
+	::operator delete(line, std::align_val_t(cache_line));
+}
+
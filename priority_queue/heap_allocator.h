@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// Allocator for heap arrays. The array starts one element short of a cache
+// line boundary, which puts the root's children, and from there every group
+// of arity children, at the start of a line: with arity * sizeof(T) a
+// multiple of the line size each group fills whole lines, and with it a
+// divisor of the line size each group sits within one. Element types that do
+// not divide the line size are allocated as usual.
+template<typename T>
+class heap_allocator
+{
+public:
+	using value_type = T;
+
+	static constexpr size_t cache_line = 64;
+
+	heap_allocator() = default;
+	template<typename U>
+	heap_allocator(const heap_allocator<U>&) {}
+
+	T* allocate(size_t count);
+	void deallocate(T* pointer, size_t count);
+
+	template<typename U>
+	bool operator==(const heap_allocator<U>&) const { return true; }
+	template<typename U>
+	bool operator!=(const heap_allocator<U>&) const { return false; }
+
+private:
+	static constexpr bool shifted = sizeof(T) < cache_line && cache_line % sizeof(T) == 0 && alignof(T) <= cache_line;
+};
@@ -1,16 +1,24 @@
+#pragma once
 #include "heap_functions.h"
 
-int left(int index)
+template<size_t arity>
+inline size_t first_child(size_t index)
 {
-	return index * 2 + 1;
+	return index * arity + 1;
 }
 
-int right(int index)
+template<size_t arity>
+inline size_t parent(size_t index)
 {
-	return index * 2 + 2;
+	return (index - 1) / arity;
 }
 
-int parent(int index)
+inline size_t left(size_t index)
 {
-	return (index - 1) / 2;
+	return index * 2 + 1;
+}
+
+inline size_t right(size_t index)
+{
+	return index * 2 + 2;
 }
\ No newline at end of file
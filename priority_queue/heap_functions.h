@@ -1,3 +1,11 @@
-int left(int);
-int right(int);
-int parent(int);
\ No newline at end of file
+#pragma once
+#include <cstddef>
+
+// Index arithmetic of an arity-ary heap stored in an array, root at 0.
+template<size_t arity = 2>
+size_t first_child(size_t);
+template<size_t arity = 2>
+size_t parent(size_t);
+
+size_t left(size_t);
+size_t right(size_t);
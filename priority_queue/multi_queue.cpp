@@ -0,0 +1,150 @@
+#pragma once
+#include "multi_queue.h"
+
+
+template<typename T, typename compare, size_t arity>
+multi_queue<T, compare, arity>::multi_queue(size_t threads, size_t queues_per_thread)
+{
+	shard_count = (threads ? threads : 1) * (queues_per_thread ? queues_per_thread : 1);
+	// two choices need two heaps
+	if (shard_count < 2) shard_count = 2;
+	shards = new shard[shard_count];
+}
+
+template<typename T, typename compare, size_t arity>
+inline multi_queue<T, compare, arity>::~multi_queue()
+{
+	delete[] shards;
+}
+
+
+// xorshift, one state per thread so picking a heap shares nothing
+template<typename T, typename compare, size_t arity>
+inline size_t multi_queue<T, compare, arity>::random_shard() const
+{
+	thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+	return static_cast<size_t>((state >> 32) * shard_count >> 32);
+}
+
+template<typename T, typename compare, size_t arity>
+void multi_queue<T, compare, arity>::push(T element)
+{
+	for (;;)
+	{
+		shard& current_shard = shards[random_shard()];
+		if (current_shard.lock.try_lock())
+		{
+			current_shard.heap.push(std::move(element));
+			current_shard.size.store(current_shard.heap.size(), std::memory_order_relaxed);
+			current_shard.lock.unlock();
+			return;
+		}
+	}
+}
+
+template<typename T, typename compare, size_t arity>
+bool multi_queue<T, compare, arity>::try_pop(T& result)
+{
+	for (int attempt = 0; attempt < random_attempts; ++attempt)
+	{
+		shard* first = &shards[random_shard()];
+		shard* second = &shards[random_shard()];
+
+		if (first->size.load(std::memory_order_relaxed) == 0) std::swap(first, second);
+		if (second->size.load(std::memory_order_relaxed) == 0 || second == first) second = nullptr;
+		if (first->size.load(std::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+
+		if (!first->lock.try_lock())
+		{
+			continue;
+		}
+		if (second && !second->lock.try_lock())
+		{
+			second = nullptr;
+		}
+
+		// sizes were read unlocked, the tops are compared under the locks
+		shard* best = first->heap.empty() ? second : first;
+		if (second && best == first && !second->heap.empty() && compare()(first->heap.top(), second->heap.top()))
+		{
+			best = second;
+		}
+
+		if (best && !best->heap.empty())
+		{
+			best->heap.pop_n(1, &result);
+			best->size.store(best->heap.size(), std::memory_order_relaxed);
+		}
+		else
+		{
+			best = nullptr;
+		}
+
+		first->lock.unlock();
+		if (second) second->lock.unlock();
+
+		if (best)
+		{
+			return true;
+		}
+	}
+
+	// random picks kept missing: nearly empty, so look at every heap in turn
+	shard* found = lock_nonempty();
+	if (!found)
+	{
+		return false;
+	}
+	found->heap.pop_n(1, &result);
+	found->size.store(found->heap.size(), std::memory_order_relaxed);
+	found->lock.unlock();
+	return true;
+}
+
+template<typename T, typename compare, size_t arity>
+typename multi_queue<T, compare, arity>::shard* multi_queue<T, compare, arity>::lock_nonempty()
+{
+	size_t start = random_shard();
+
+	for (size_t offset = 0; offset < shard_count; ++offset)
+	{
+		shard& current_shard = shards[(start + offset) % shard_count];
+		if (current_shard.size.load(std::memory_order_relaxed) == 0)
+		{
+			continue;
+		}
+
+		current_shard.lock.lock();
+		if (!current_shard.heap.empty())
+		{
+			return &current_shard;
+		}
+		current_shard.lock.unlock();
+	}
+	return nullptr;
+}
+
+
+template<typename T, typename compare, size_t arity>
+size_t multi_queue<T, compare, arity>::size() const
+{
+	size_t total = 0;
+	for (size_t index = 0; index < shard_count; ++index)
+	{
+		total += shards[index].size.load(std::memory_order_relaxed);
+	}
+	return total;
+}
+
+template<typename T, typename compare, size_t arity>
+inline bool multi_queue<T, compare, arity>::empty() const
+{
+	return size() == 0;
+}
+
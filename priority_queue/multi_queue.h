@@ -0,0 +1,62 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include "priority_queue.cpp"
+
+// Relaxed concurrent priority queue (MultiQueue, Rihani, Sanders and
+// Dementiev): c * P ordinary heaps, each behind its own lock. push goes to a
+// random heap; pop looks at two random heaps and takes the better top. Locks
+// are tried rather than waited for: a busy heap just means another random
+// pick, so threads do not queue up behind each other. Only when the random
+// picks keep finding empty heaps does pop go through all of them, locking
+// each in turn, to tell whether the queue is empty.
+//
+// Popped elements are not exactly in priority order. With n heaps an element
+// is, in expectation, ahead of O(n) better ones at the time it is popped, and
+// of O(n log n) with high probability (Alistarh et al., "The power of choice
+// in priority scheduling"); no element is passed over forever. try_pop may
+// report the queue empty while a concurrent push is still in flight.
+// multi_queue_bench.cpp measures both the rank errors and the throughput:
+// with one thread the mean comes out at about 0.8 n for 2 to 64 heaps. A
+// thread descheduled while it holds a heap's lock hides that heap, so with
+// more threads than cores the tail grows with the time slice.
+template <typename T, typename compare = greater<T>, size_t arity = 2>
+class multi_queue
+{
+private:
+	struct alignas(64) shard
+	{
+		std::mutex lock;
+		priority_queue<T, compare, arity> heap;
+		std::atomic<size_t> size{ 0 };	// read without the lock to skip empty heaps
+	};
+
+	shard* shards;
+	size_t shard_count;
+
+	// pops tried on random pairs before falling back to a sweep over all heaps
+	static constexpr int random_attempts = 8;
+
+	size_t random_shard() const;
+	// locks a heap that is not empty, nullptr if there is none
+	shard* lock_nonempty();
+
+public:
+	explicit multi_queue(size_t threads = std::thread::hardware_concurrency(), size_t queues_per_thread = 2);
+	~multi_queue();
+	multi_queue(const multi_queue&) = delete;
+	multi_queue& operator=(const multi_queue&) = delete;
+
+	void push(T element);
+	// false if every heap was found empty
+	bool try_pop(T& result);
+
+	// a snapshot that may be stale by the time it is returned
+	size_t size() const;
+	bool empty() const;
+};
@@ -0,0 +1,282 @@
+// Standalone throughput and rank-error driver for multi_queue:
+//   g++ -std=c++17 -O2 -pthread multi_queue_bench.cpp && ./a.out [max_threads] [operations]
+// For 1, 2, 4, ... max_threads threads (32 by default) each thread alternates
+// push and try_pop on a prefilled queue. Reports ops/s for multi_queue and for
+// one priority_queue behind a mutex, and the distribution of rank errors;
+// then the rank errors of a single thread for 2 to 64 heaps, against the
+// O(n) bound in multi_queue.h.
+//
+// The rank error of a pop is the number of elements in the queue that were
+// better than the one it returned. It is found by a second, logged run:
+// every operation takes a ticket from a global counter, a push after it
+// returns and a pop before it starts, and the log is replayed in ticket
+// order against an exact count of the elements present. An element thus
+// counts from the end of its push to the start of its pop, when it is surely
+// in the queue; pushes still in flight are missed, so with several threads
+// this is a slight underestimate. With one thread it is exact.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "multi_queue.cpp"
+
+
+// a random priority in the high bits, the pushing thread and a counter below
+// it, so that every key is distinct and ranks are well defined
+struct key_source
+{
+	uint64_t state;
+	uint64_t counter;
+	uint64_t thread;
+
+	explicit key_source(uint64_t thread) : state(thread * 0x9E3779B97F4A7C15ull + 1), counter(0), thread(thread) {}
+
+	uint64_t next()
+	{
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return (state >> 40 << 40) | (thread << 32) | counter++;
+	}
+};
+
+struct logged_operation
+{
+	uint64_t ticket;
+	uint64_t key;
+	bool is_push;
+};
+
+// counts of the keys present, by position in the sorted list of all keys
+class fenwick_tree
+{
+private:
+	std::vector<int> counts;
+
+public:
+	explicit fenwick_tree(size_t length) : counts(length + 1, 0) {}
+
+	void add(size_t index, int delta)
+	{
+		for (++index; index < counts.size(); index += index & (0 - index))
+		{
+			counts[index] += delta;
+		}
+	}
+
+	// sum over the positions before index
+	int prefix(size_t index) const
+	{
+		int sum = 0;
+		for (; index > 0; index -= index & (0 - index))
+		{
+			sum += counts[index];
+		}
+		return sum;
+	}
+};
+
+template<typename function_type>
+double run_threads(size_t threads, function_type function)
+{
+	std::vector<std::thread> workers;
+	std::atomic<bool> start{ false };
+
+	for (size_t thread = 0; thread < threads; ++thread)
+	{
+		workers.emplace_back([&, thread]
+		{
+			while (!start.load()) std::this_thread::yield();
+			function(thread);
+		});
+	}
+
+	auto begin = std::chrono::steady_clock::now();
+	start.store(true);
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+void prefill(multi_queue<uint64_t>& queue, size_t count)
+{
+	key_source keys(1000);
+	for (size_t index = 0; index < count; ++index)
+	{
+		queue.push(keys.next());
+	}
+}
+
+double multi_queue_throughput(size_t threads, size_t operations, size_t prefilled)
+{
+	multi_queue<uint64_t> queue(threads);
+	prefill(queue, prefilled);
+
+	double seconds = run_threads(threads, [&](size_t thread)
+	{
+		key_source keys(thread);
+		uint64_t popped;
+		for (size_t index = 0; index < operations / threads / 2; ++index)
+		{
+			queue.push(keys.next());
+			queue.try_pop(popped);
+		}
+	});
+	return operations / seconds;
+}
+
+double locked_heap_throughput(size_t threads, size_t operations, size_t prefilled)
+{
+	priority_queue<uint64_t> heap;
+	std::mutex lock;
+	key_source prefill_keys(1000);
+	for (size_t index = 0; index < prefilled; ++index)
+	{
+		heap.push(prefill_keys.next());
+	}
+
+	double seconds = run_threads(threads, [&](size_t thread)
+	{
+		key_source keys(thread);
+		for (size_t index = 0; index < operations / threads / 2; ++index)
+		{
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				heap.push(keys.next());
+			}
+			std::lock_guard<std::mutex> guard(lock);
+			heap.pop();
+		}
+	});
+	return operations / seconds;
+}
+
+// rank error of every pop of a logged run, see the comment at the top
+std::vector<int> rank_errors(size_t threads, size_t heaps, size_t operations, size_t prefilled)
+{
+	multi_queue<uint64_t> queue(heaps, 1);
+	std::atomic<uint64_t> tickets{ 0 };
+	std::vector<std::vector<logged_operation>> logs(threads + 1);
+
+	key_source prefill_keys(1000);
+	for (size_t index = 0; index < prefilled; ++index)
+	{
+		uint64_t key = prefill_keys.next();
+		logs[threads].push_back({ tickets++, key, true });
+		queue.push(key);
+	}
+
+	run_threads(threads, [&](size_t thread)
+	{
+		key_source keys(thread);
+		std::vector<logged_operation>& log = logs[thread];
+		log.reserve(operations / threads + 2);
+
+		for (size_t index = 0; index < operations / threads / 2; ++index)
+		{
+			uint64_t key = keys.next();
+			queue.push(key);
+			log.push_back({ tickets.fetch_add(1), key, true });
+
+			uint64_t ticket = tickets.fetch_add(1);
+			if (queue.try_pop(key))
+			{
+				log.push_back({ ticket, key, false });
+			}
+		}
+	});
+
+	std::vector<logged_operation> all;
+	std::vector<uint64_t> keys;
+	for (const std::vector<logged_operation>& log : logs)
+	{
+		for (const logged_operation& operation : log)
+		{
+			all.push_back(operation);
+			if (operation.is_push) keys.push_back(operation.key);
+		}
+	}
+	std::sort(all.begin(), all.end(), [](const logged_operation& first, const logged_operation& second) { return first.ticket < second.ticket; });
+	std::sort(keys.begin(), keys.end());
+
+	// greater<T> makes the smallest key the best, so the rank is the count of
+	// smaller keys present. A pop can start before the push of its element
+	// returns; such an element is never counted.
+	enum : char { absent, present, popped_early };
+	fenwick_tree counted(keys.size());
+	std::vector<char> state(keys.size(), absent);
+	std::vector<int> errors;
+	for (const logged_operation& operation : all)
+	{
+		size_t position = std::lower_bound(keys.begin(), keys.end(), operation.key) - keys.begin();
+		if (operation.is_push)
+		{
+			if (state[position] == absent)
+			{
+				state[position] = present;
+				counted.add(position, 1);
+			}
+		}
+		else
+		{
+			errors.push_back(counted.prefix(position));
+			if (state[position] == present)
+			{
+				counted.add(position, -1);
+			}
+			state[position] = popped_early;
+		}
+	}
+	std::sort(errors.begin(), errors.end());
+	return errors;
+}
+
+void print_errors(const std::vector<int>& errors, size_t heaps)
+{
+	double mean = 0;
+	for (int error : errors)
+	{
+		mean += error;
+	}
+	mean /= errors.size();
+	auto percentile = [&](double fraction) { return errors[static_cast<size_t>(fraction * (errors.size() - 1))]; };
+
+	std::printf("%17.1f %5d %5d %5d %6d  %10.2f\n",
+		mean, percentile(0.5), percentile(0.9), percentile(0.99), errors.back(), mean / heaps);
+}
+
+int main(int argc, char** argv)
+{
+	size_t max_threads = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 32;
+	size_t operations = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 2000000;
+	size_t prefilled = 100000;
+
+	std::printf("%u hardware threads, %zu operations, %zu elements prefilled, 2 heaps per thread\n\n",
+		std::thread::hardware_concurrency(), operations, prefilled);
+	std::printf("threads  heaps   multi_queue Mops/s  locked heap Mops/s   rank error: mean   p50   p90   p99    max  mean/heaps\n");
+
+	for (size_t threads = 1; threads <= max_threads; threads *= 2)
+	{
+		double relaxed = multi_queue_throughput(threads, operations, prefilled);
+		double locked = locked_heap_throughput(threads, operations, prefilled);
+
+		size_t heaps = threads * 2;
+		std::printf("%7zu  %5zu  %18.2f  %18.2f  ", threads, heaps, relaxed / 1e6, locked / 1e6);
+		print_errors(rank_errors(threads, heaps, operations, prefilled), heaps);
+	}
+
+	std::printf("\none thread\n  heaps   rank error: mean   p50   p90   p99    max  mean/heaps\n");
+	for (size_t heaps = 2; heaps <= 64; heaps *= 2)
+	{
+		std::printf("  %5zu  ", heaps);
+		print_errors(rank_errors(1, heaps, operations, prefilled), heaps);
+	}
+	return 0;
+}
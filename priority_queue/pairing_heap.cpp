@@ -0,0 +1,244 @@
+#pragma once
+#include "pairing_heap.h"
+
+
+template<typename T, typename compare, typename allocator>
+inline pairing_heap<T, compare, allocator>::pairing_heap() : root(nullptr), m_size(0) {}
+
+template<typename T, typename compare, typename allocator>
+inline pairing_heap<T, compare, allocator>::pairing_heap(const allocator& alloc) : root(nullptr), m_size(0), alloc(alloc) {}
+
+template<typename T, typename compare, typename allocator>
+inline pairing_heap<T, compare, allocator>::~pairing_heap()
+{
+	release();
+}
+
+template<typename T, typename compare, typename allocator>
+pairing_heap<T, compare, allocator>::pairing_heap(const pairing_heap& other) :
+	root(nullptr), m_size(0), alloc(std::allocator_traits<node_allocator>::select_on_container_copy_construction(other.alloc))
+{
+	init(other);
+}
+
+template<typename T, typename compare, typename allocator>
+pairing_heap<T, compare, allocator>& pairing_heap<T, compare, allocator>::operator=(const pairing_heap& other)
+{
+	if (this != &other)
+	{
+		release();
+		init(other);
+	}
+	return *this;
+}
+
+// The allocator is copied, as in map, so the emptied heap can still allocate.
+template<typename T, typename compare, typename allocator>
+inline pairing_heap<T, compare, allocator>::pairing_heap(pairing_heap&& other) : root(other.root), m_size(other.m_size), alloc(other.alloc)
+{
+	other.root = nullptr;
+	other.m_size = 0;
+}
+
+
+template<typename T, typename compare, typename allocator>
+inline typename pairing_heap<T, compare, allocator>::node* pairing_heap<T, compare, allocator>::link(node* first, node* second)
+{
+	if (compare()(first->element, second->element))
+	{
+		std::swap(first, second);
+	}
+
+	second->sibling = first->child;
+	first->child = second;
+	return first;
+}
+
+template<typename T, typename compare, typename allocator>
+typename pairing_heap<T, compare, allocator>::node* pairing_heap<T, compare, allocator>::combine(node* first_sibling)
+{
+	// first pass, left to right: link neighbours in pairs, collecting the
+	// winners in reverse order through their sibling pointers
+	node* pairs = nullptr;
+	while (first_sibling)
+	{
+		node* first = first_sibling;
+		node* second = first->sibling;
+		if (!second)
+		{
+			first->sibling = pairs;
+			pairs = first;
+			break;
+		}
+
+		first_sibling = second->sibling;
+		first->sibling = second->sibling = nullptr;
+		node* winner = link(first, second);
+		winner->sibling = pairs;
+		pairs = winner;
+	}
+
+	// second pass, right to left: fold the pairs into one tree
+	node* result = nullptr;
+	while (pairs)
+	{
+		node* next = pairs->sibling;
+		pairs->sibling = nullptr;
+		result = result ? link(result, pairs) : pairs;
+		pairs = next;
+	}
+	return result;
+}
+
+
+template<typename T, typename compare, typename allocator>
+inline const T& pairing_heap<T, compare, allocator>::top() const
+{
+	return root->element;
+}
+
+template<typename T, typename compare, typename allocator>
+inline void pairing_heap<T, compare, allocator>::push(const T& element)
+{
+	node* new_node = create_node(element);
+	root = root ? link(root, new_node) : new_node;
+	++m_size;
+}
+
+template<typename T, typename compare, typename allocator>
+inline void pairing_heap<T, compare, allocator>::push(T&& element)
+{
+	node* new_node = create_node(std::move(element));
+	root = root ? link(root, new_node) : new_node;
+	++m_size;
+}
+
+template<typename T, typename compare, typename allocator>
+void pairing_heap<T, compare, allocator>::pop()
+{
+	if (!root)
+	{
+		return;
+	}
+
+	node* old_root = root;
+	root = combine(root->child);
+	destroy_node(old_root);
+	--m_size;
+}
+
+template<typename T, typename compare, typename allocator>
+void pairing_heap<T, compare, allocator>::meld(pairing_heap& other)
+{
+	if (this == &other || !other.root)
+	{
+		return;
+	}
+
+	if (merge_nodes(alloc, other.alloc))
+	{
+		root = root ? link(root, other.root) : other.root;
+		m_size += other.m_size;
+		other.root = nullptr;
+		other.m_size = 0;
+		return;
+	}
+
+	while (!other.empty())
+	{
+		push(std::move(other.root->element));
+		other.pop();
+	}
+}
+
+
+template<typename T, typename compare, typename allocator>
+template<typename U>
+inline typename pairing_heap<T, compare, allocator>::node* pairing_heap<T, compare, allocator>::create_node(U&& element)
+{
+	node* new_node = std::allocator_traits<node_allocator>::allocate(alloc, 1);
+	std::allocator_traits<node_allocator>::construct(alloc, new_node, std::forward<U>(element));
+	return new_node;
+}
+
+template<typename T, typename compare, typename allocator>
+inline void pairing_heap<T, compare, allocator>::destroy_node(node* this_node)
+{
+	std::allocator_traits<node_allocator>::destroy(alloc, this_node);
+	std::allocator_traits<node_allocator>::deallocate(alloc, this_node, 1);
+}
+
+template<typename T, typename compare, typename allocator>
+void pairing_heap<T, compare, allocator>::release()
+{
+	if (root && !release_nodes<node>(alloc))
+	{
+		std::vector<node*> stack;
+		stack.push_back(root);
+
+		while (!stack.empty())
+		{
+			node* current_node = stack.back();
+			stack.pop_back();
+
+			if (current_node->child) stack.push_back(current_node->child);
+			if (current_node->sibling) stack.push_back(current_node->sibling);
+			destroy_node(current_node);
+		}
+	}
+	root = nullptr;
+	m_size = 0;
+}
+
+// copies the shape as well, child and sibling links alike
+template<typename T, typename compare, typename allocator>
+void pairing_heap<T, compare, allocator>::init(const pairing_heap& other)
+{
+	m_size = other.m_size;
+	if (!other.root)
+	{
+		root = nullptr;
+		return;
+	}
+
+	root = create_node(other.root->element);
+	std::vector<std::pair<node*, const node*>> stack;
+	stack.push_back({ root, other.root });
+
+	while (!stack.empty())
+	{
+		std::pair<node*, const node*> pair = stack.back();
+		stack.pop_back();
+
+		if (pair.second->child)
+		{
+			pair.first->child = create_node(pair.second->child->element);
+			stack.push_back({ pair.first->child, pair.second->child });
+		}
+		if (pair.second->sibling)
+		{
+			pair.first->sibling = create_node(pair.second->sibling->element);
+			stack.push_back({ pair.first->sibling, pair.second->sibling });
+		}
+	}
+}
+
+
+template<typename T, typename compare, typename allocator>
+inline void pairing_heap<T, compare, allocator>::clear()
+{
+	release();
+}
+
+template<typename T, typename compare, typename allocator>
+inline bool pairing_heap<T, compare, allocator>::empty() const
+{
+	return root == nullptr;
+}
+
+template<typename T, typename compare, typename allocator>
+inline int pairing_heap<T, compare, allocator>::size() const
+{
+	return m_size;
+}
+
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "basic_comparators.cpp"
+#include "../memory/node_pool.h"
+
+// Mergeable heap: a pairing heap, so push and meld are O(1) and pop is
+// amortized O(log n). Nodes come from allocator, a node_pool by default.
+//
+// meld relinks the nodes of other when both heaps can free them: when they
+// share a pool, or when other's pool serves other alone and is merged into
+// this one. Otherwise the elements of other are pushed one by one.
+template <typename T, typename compare = greater<T>, typename allocator = pool_allocator<T>>
+class pairing_heap
+{
+private:
+	struct node
+	{
+		T element;
+		node* child;	// first child, the rest hang off its sibling list
+		node* sibling;
+
+		template<typename U>
+		explicit node(U&& element) : element(std::forward<U>(element)), child(nullptr), sibling(nullptr) {}
+	};
+
+	using node_allocator = typename std::allocator_traits<allocator>::template rebind_alloc<node>;
+
+	node* root;
+	size_t m_size;
+	node_allocator alloc;
+
+	// the root with the lower priority becomes the first child of the other
+	static node* link(node* first, node* second);
+	// two-pass pairing of a sibling list into a single tree
+	static node* combine(node* first_sibling);
+
+	template<typename U>
+	node* create_node(U&& element);
+	void destroy_node(node* this_node);
+	void release();
+	void init(const pairing_heap& other);
+
+public:
+	pairing_heap();
+	explicit pairing_heap(const allocator& alloc);
+	~pairing_heap();
+	pairing_heap(const pairing_heap& other);
+	pairing_heap& operator=(const pairing_heap& other);
+	// other is left empty
+	pairing_heap(pairing_heap&& other);
+
+	// the heap must not be empty
+	const T& top() const;
+	void push(const T& element);
+	void push(T&& element);
+	void pop();
+	// moves every element of other into this heap, other is left empty
+	void meld(pairing_heap& other);
+
+	void clear();
+	bool empty() const;
+	int size() const;
+};
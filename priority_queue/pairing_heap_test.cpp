@@ -0,0 +1,97 @@
+// Standalone check of pairing_heap with its default pool_allocator:
+//   g++ -std=c++17 -O2 pairing_heap_test.cpp && ./a.out
+// Every allocation goes through the counting operator new below, so a node
+// that clear() or a destructor forgets shows up as a live allocation.
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include "pairing_heap.cpp"
+
+
+static size_t live_allocations = 0;
+
+void* operator new(size_t bytes)
+{
+	++live_allocations;
+	if (void* pointer = std::malloc(bytes ? bytes : 1))
+	{
+		return pointer;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void* pointer) noexcept
+{
+	if (pointer)
+	{
+		--live_allocations;
+		std::free(pointer);
+	}
+}
+
+void operator delete(void* pointer, size_t) noexcept
+{
+	operator delete(pointer);
+}
+
+
+// bigger than node_pool::max_node_size, so its nodes come from operator new
+struct large_element
+{
+	int key;
+	char payload[400];
+
+	large_element(int key = 0) : key(key), payload() {}
+	bool operator>(const large_element& other) const { return key > other.key; }
+};
+
+// pushes keys in a scrambled order, melds and pops, checking the order
+// and that every node is given back
+template<typename T>
+void check_heap(const char* name)
+{
+	size_t before = live_allocations;
+	{
+		pairing_heap<T> first, second;
+		for (int index = 0; index < 500; ++index)
+		{
+			first.push(T(index * 7919 % 1000));
+			second.push(T(index * 7919 % 1000 + 1));
+		}
+		first.meld(second);
+		assert(second.empty() && first.size() == 1000);
+
+		int last = -1;
+		for (int index = 0; index < 500; ++index)
+		{
+			assert(first.top().key >= last);
+			last = first.top().key;
+			first.pop();
+		}
+
+		pairing_heap<T> copy = first;
+		copy.clear();
+		for (int index = 0; index < 10; ++index)
+		{
+			copy.push(T(index));
+		}
+	}
+	assert(live_allocations == before);
+	std::printf("%s: ok\n", name);
+}
+
+struct small_element
+{
+	int key;
+
+	small_element(int key = 0) : key(key) {}
+	bool operator>(const small_element& other) const { return key > other.key; }
+};
+
+int main()
+{
+	check_heap<small_element>("pooled nodes");
+	check_heap<large_element>("nodes over max_node_size");
+	return 0;
+}
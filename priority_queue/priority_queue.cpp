@@ -2,56 +2,100 @@
 #include "priority_queue.h"
 
 
-template<typename T, typename compare>
-void priority_queue<T, compare>::sift_down(int index)
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::sift_down(size_t index)
 {
-	while (true)
+	size_t size = heap.size();
+	T element = std::move(heap[index]);
+
+	while (first_child<arity>(index) < size)
 	{
-		int index_max = index;
+		size_t first = first_child<arity>(index);
+		size_t last = first + arity < size ? first + arity : size;
+		size_t index_max = first;
 
-		if (left(index) < heap.size() && compare()(heap[index_max], heap[left(index)]))
-		{
-			index_max = left(index);
-		}
-		if (right(index) < heap.size() && compare()(heap[index_max], heap[right(index)]))
+		for (size_t child = first + 1; child < last; ++child)
 		{
-			index_max = right(index);
+			if (compare()(heap[index_max], heap[child]))
+			{
+				index_max = child;
+			}
 		}
-		if (index == index_max)
+		if (!compare()(element, heap[index_max]))
 		{
 			break;
 		}
 
-		std::swap(heap[index], heap[index_max]);
+		heap[index] = std::move(heap[index_max]);
 		index = index_max;
 	}
+
+	heap[index] = std::move(element);
 }
 
-template<typename T, typename compare>
-void priority_queue<T, compare>::sift_up(int index)
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::sift_up(size_t index)
 {
-	while (index != 0 && compare()(heap[parent(index)], heap[index]))
+	T element = std::move(heap[index]);
+
+	while (index != 0 && compare()(heap[parent<arity>(index)], element))
 	{
-		std::swap(heap[index], heap[parent(index)]);
-		index = parent(index);
+		heap[index] = std::move(heap[parent<arity>(index)]);
+		index = parent<arity>(index);
 	}
+
+	heap[index] = std::move(element);
 }
 
 
-template<typename T, typename compare>
-inline bool priority_queue<T, compare>::empty() const
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::heapify()
+{
+	if (heap.size() < 2)
+	{
+		return;
+	}
+
+	for (size_t index = parent<arity>(heap.size() - 1) + 1; index-- > 0;)
+	{
+		sift_down(index);
+	}
+}
+
+
+template<typename T, typename compare, size_t arity>
+inline priority_queue<T, compare, arity>::priority_queue() {}
+
+template<typename T, typename compare, size_t arity>
+template<typename iterator_type>
+priority_queue<T, compare, arity>::priority_queue(iterator_type first, iterator_type last) : heap(first, last)
+{
+	heapify();
+}
+
+template<typename T, typename compare, size_t arity>
+priority_queue<T, compare, arity>::priority_queue(std::vector<T>&& elements) :
+	heap(std::make_move_iterator(elements.begin()), std::make_move_iterator(elements.end()))
+{
+	elements.clear();
+	heapify();
+}
+
+
+template<typename T, typename compare, size_t arity>
+inline bool priority_queue<T, compare, arity>::empty() const
 {
 	return heap.empty();
 }
 
-template<typename T, typename compare>
-int priority_queue<T, compare>::size() const
+template<typename T, typename compare, size_t arity>
+int priority_queue<T, compare, arity>::size() const
 {
 	return heap.size();
 }
 
-template<typename T, typename compare>
-void priority_queue<T, compare>::print_heap() const
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::print_heap() const
 {
 	for (int element : heap)
 	{
@@ -59,30 +103,89 @@ void priority_queue<T, compare>::print_heap() const
 	}
 }
 
-template<typename T, typename compare>
-inline T priority_queue<T, compare>::top() const
+template<typename T, typename compare, size_t arity>
+inline const T& priority_queue<T, compare, arity>::top() const
 {
-	if (!heap.empty())
-	{
-		return heap[0];
-	}
+	return heap.front();
 }
 
-template<typename T, typename compare>
-void priority_queue<T, compare>::push(T element)
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::push(T element)
 {
-	heap.push_back(element);
+	heap.push_back(std::move(element));
 	sift_up(heap.size() - 1);
 }
 
-template<typename T, typename compare>
-void priority_queue<T, compare>::pop()
+template<typename T, typename compare, size_t arity>
+template<typename iterator_type>
+void priority_queue<T, compare, arity>::push_range(iterator_type first, iterator_type last)
+{
+	size_t old_size = heap.size();
+	heap.insert(heap.end(), first, last);
+
+	// sift_up is cheap for a few new elements, while a batch at least as
+	// long as the old heap is sooner done by rebuilding
+	if (heap.size() - old_size >= old_size)
+	{
+		heapify();
+		return;
+	}
+	for (size_t index = old_size; index < heap.size(); ++index)
+	{
+		sift_up(index);
+	}
+}
+
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::pop()
 {
 	if (heap.size() > 0)
 	{
-		heap[0] = heap[heap.size() - 1];
+		if (heap.size() > 1)
+		{
+			heap[0] = std::move(heap.back());
+		}
 		heap.pop_back();
-		sift_down(0);
+		if (!heap.empty())
+		{
+			sift_down(0);
+		}
+	}
+}
+
+template<typename T, typename compare, size_t arity>
+void priority_queue<T, compare, arity>::replace_top(T element)
+{
+	if (heap.empty())
+	{
+		heap.push_back(std::move(element));
+		return;
+	}
+
+	heap.front() = std::move(element);
+	sift_down(0);
+}
+
+template<typename T, typename compare, size_t arity>
+template<typename output_iterator>
+output_iterator priority_queue<T, compare, arity>::pop_n(size_t count, output_iterator out)
+{
+	for (; count > 0 && !heap.empty(); --count)
+	{
+		*out = std::move(heap.front());
+		++out;
+
+		if (heap.size() > 1)
+		{
+			heap.front() = std::move(heap.back());
+			heap.pop_back();
+			sift_down(0);
+		}
+		else
+		{
+			heap.pop_back();
+		}
 	}
+	return out;
 }
 
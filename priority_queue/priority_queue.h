@@ -1,21 +1,48 @@
+#pragma once
 #include <iostream>
+#include <iterator>
 #include <vector>
 #include "basic_comparators.cpp"
 #include "heap_functions.cpp"
+#include "heap_allocator.cpp"
 
-template <typename T, typename compare = greater<T>>
+// arity children per node; 4 and 8 make shallower heaps whose children
+// share a cache line, see heap_allocator.h
+template <typename T, typename compare = greater<T>, size_t arity = 2>
 class priority_queue
 {
+	static_assert(arity >= 2, "a heap needs at least two children per node");
+
 private:
-	std::vector<T> heap;
-	void sift_down(int index);
-	void sift_up(int index);
+	std::vector<T, heap_allocator<T>> heap;
+	// both move the element into a hole instead of swapping at every level
+	void sift_down(size_t index);
+	void sift_up(size_t index);
+	// Floyd's bottom-up construction, O(n)
+	void heapify();
 
 public:
+	priority_queue();
+	// O(n) from the range, instead of one push per element
+	template<typename iterator_type>
+	priority_queue(iterator_type first, iterator_type last);
+	explicit priority_queue(std::vector<T>&& elements);
+
 	void print_heap() const;
-	T top() const;
+	// the queue must not be empty
+	const T& top() const;
 	void push(T element);
+	// pushes the range one by one, or appends it and rebuilds the whole
+	// heap when it is at least as long as the heap already is
+	template<typename iterator_type>
+	void push_range(iterator_type first, iterator_type last);
 	void pop();
+	// pop followed by push(element), with a single sift_down
+	void replace_top(T element);
+	// moves the top count elements (fewer if there are not that many) to
+	// out in priority order and returns out past the last one
+	template<typename output_iterator>
+	output_iterator pop_n(size_t count, output_iterator out);
 	bool empty() const;
 	int size() const;
-};
\ No newline at end of file
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <cassert>
+#include "radix_heap.h"
+
+
+template<typename key, typename value>
+inline radix_heap<key, value>::radix_heap() : last(0), m_size(0) {}
+
+
+template<typename key, typename value>
+inline size_t radix_heap<key, value>::bucket_of(code_type code) const
+{
+	uint64_t difference = static_cast<uint64_t>(code ^ last);
+	if (difference == 0)
+	{
+		return 0;
+	}
+
+#if defined(__GNUC__) || defined(__clang__)
+	return 64 - __builtin_clzll(difference);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, difference);
+	return index + 1;
+#else
+	size_t bits = 0;
+	for (; difference; difference >>= 1) ++bits;
+	return bits;
+#endif
+}
+
+template<typename key, typename value>
+void radix_heap<key, value>::pull() const
+{
+	if (!buckets[0].empty())
+	{
+		return;
+	}
+
+	size_t index = 1;
+	while (buckets[index].empty())
+	{
+		++index;
+	}
+
+	code_type minimum = traits::encode(buckets[index][0].first);
+	for (const std::pair<key, value>& element : buckets[index])
+	{
+		code_type code = traits::encode(element.first);
+		if (code < minimum) minimum = code;
+	}
+
+	// everything here shares the bits above index with minimum, so it
+	// lands in a lower bucket
+	last = minimum;
+	for (std::pair<key, value>& element : buckets[index])
+	{
+		buckets[bucket_of(traits::encode(element.first))].push_back(std::move(element));
+	}
+	buckets[index].clear();
+}
+
+
+template<typename key, typename value>
+inline const std::pair<key, value>& radix_heap<key, value>::top() const
+{
+	pull();
+	return buckets[0].back();
+}
+
+template<typename key, typename value>
+inline void radix_heap<key, value>::push(key current_key, value current_value)
+{
+	code_type code = traits::encode(current_key);
+	assert(code >= last && "radix_heap keys must not decrease");
+
+	buckets[bucket_of(code)].emplace_back(current_key, std::move(current_value));
+	++m_size;
+}
+
+template<typename key, typename value>
+inline void radix_heap<key, value>::pop()
+{
+	if (m_size == 0)
+	{
+		return;
+	}
+
+	pull();
+	buckets[0].pop_back();
+	--m_size;
+}
+
+template<typename key, typename value>
+void radix_heap<key, value>::clear()
+{
+	for (std::vector<std::pair<key, value>>& bucket : buckets)
+	{
+		bucket.clear();
+	}
+	last = 0;
+	m_size = 0;
+}
+
+template<typename key, typename value>
+inline bool radix_heap<key, value>::empty() const
+{
+	return m_size == 0;
+}
+
+template<typename key, typename value>
+inline int radix_heap<key, value>::size() const
+{
+	return m_size;
+}
+
@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Order-preserving map of a key onto an unsigned integer: unsigned keys as
+// they are, signed ones with the sign bit flipped, floating point ones by
+// their bits with negative values turned around. -0.0 is encoded as 0.0,
+// which it compares equal to.
+template<typename key, typename = void>
+struct radix_key_traits;
+
+template<typename key>
+struct radix_key_traits<key, std::enable_if_t<std::is_integral<key>::value>>
+{
+	using code_type = std::make_unsigned_t<key>;
+
+	static code_type encode(key current_key)
+	{
+		code_type code = static_cast<code_type>(current_key);
+		return std::is_signed<key>::value ? code ^ (code_type(1) << (sizeof(key) * 8 - 1)) : code;
+	}
+};
+
+template<typename key>
+struct radix_key_traits<key, std::enable_if_t<std::is_floating_point<key>::value>>
+{
+	using code_type = std::conditional_t<sizeof(key) == 4, uint32_t, uint64_t>;
+
+	static code_type encode(key current_key)
+	{
+		if (current_key == 0)
+		{
+			current_key = 0;
+		}
+
+		code_type code;
+		std::memcpy(&code, &current_key, sizeof(code));
+		code_type sign = code_type(1) << (sizeof(key) * 8 - 1);
+		return code & sign ? ~code : code | sign;
+	}
+};
+
+
+// Monotone priority queue for integer and floating point keys: the popped
+// keys must never decrease, which suits Dijkstra and event simulations.
+// Elements sit in buckets by the highest bit in which their key differs from
+// the last minimum, and an element only ever moves to a lower bucket, so
+// each one is moved at most once per bit: amortized O(log C) for keys
+// spanning a range of C.
+//
+// The smallest key comes first, as in priority_queue with its default
+// greater. A key pushed must not be less than the last one top() or pop()
+// saw; debug builds check this. NaN keys compare with nothing and are ordered
+// by their bits instead: a positive NaN after +infinity, a negative one before
+// -infinity, where it fails the check.
+template<typename key, typename value>
+class radix_heap
+{
+private:
+	using traits = radix_key_traits<key>;
+	using code_type = typename traits::code_type;
+
+	static constexpr size_t bucket_count = sizeof(code_type) * 8 + 1;
+
+	// top() moves elements between buckets, which changes no answer
+	mutable std::vector<std::pair<key, value>> buckets[bucket_count];
+	mutable code_type last;
+	size_t m_size;
+
+	// 0 for the last minimum itself, otherwise one past the highest differing bit
+	size_t bucket_of(code_type code) const;
+	// refills bucket 0 with the smallest key, the heap must not be empty
+	void pull() const;
+
+public:
+	radix_heap();
+
+	// the heap must not be empty
+	const std::pair<key, value>& top() const;
+	void push(key current_key, value current_value);
+	void pop();
+	void clear();
+	bool empty() const;
+	int size() const;
+};
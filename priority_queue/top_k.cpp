@@ -0,0 +1,158 @@
+#pragma once
+#include <algorithm>
+#include <iterator>
+#include "top_k.h"
+
+
+template<typename T, typename compare, size_t arity>
+inline top_k<T, compare, arity>::top_k(size_t capacity) : capacity(capacity) {}
+
+
+template<typename T, typename compare, size_t arity>
+inline bool top_k<T, compare, arity>::push(T element)
+{
+	if (static_cast<size_t>(heap.size()) < capacity)
+	{
+		heap.push(std::move(element));
+		return true;
+	}
+	if (capacity == 0 || !compare()(heap.top(), element))
+	{
+		return false;
+	}
+
+	heap.replace_top(std::move(element));
+	return true;
+}
+
+template<typename T, typename compare, size_t arity>
+void top_k<T, compare, arity>::push_batch(const T* elements, size_t count)
+{
+	size_t index = 0;
+	for (; index < count && static_cast<size_t>(heap.size()) < capacity; ++index)
+	{
+		heap.push(elements[index]);
+	}
+	if (capacity == 0)
+	{
+		return;
+	}
+
+	while (index < count)
+	{
+		index = skip_rejected(elements, index, count);
+
+		// a block with a candidate, or the tail: element by element, as the
+		// threshold moves with every one taken
+		size_t block_end = std::min(index + 4, count);
+		for (; index < block_end; ++index)
+		{
+			push(elements[index]);
+		}
+	}
+}
+
+template<typename T, typename compare, size_t arity>
+inline size_t top_k<T, compare, arity>::skip_rejected(const T* elements, size_t first, size_t count) const
+{
+#ifdef TOP_K_USE_SSE2
+	// better than the threshold means greater under less, smaller under greater
+	constexpr bool keeps_largest = std::is_same<compare, less<T>>::value;
+	constexpr bool keeps_smallest = std::is_same<compare, greater<T>>::value;
+
+	if constexpr ((keeps_largest || keeps_smallest) && std::is_same<T, int32_t>::value)
+	{
+		__m128i needle = _mm_set1_epi32(heap.top());
+		for (; first + 4 <= count; first += 4)
+		{
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(elements + first));
+			__m128i better = keeps_largest ? _mm_cmpgt_epi32(block, needle) : _mm_cmplt_epi32(block, needle);
+			if (_mm_movemask_epi8(better))
+			{
+				break;
+			}
+		}
+	}
+	else if constexpr ((keeps_largest || keeps_smallest) && std::is_same<T, float>::value)
+	{
+		__m128 needle = _mm_set1_ps(heap.top());
+		for (; first + 4 <= count; first += 4)
+		{
+			__m128 block = _mm_loadu_ps(elements + first);
+			__m128 better = keeps_largest ? _mm_cmpgt_ps(block, needle) : _mm_cmplt_ps(block, needle);
+			if (_mm_movemask_ps(better))
+			{
+				break;
+			}
+		}
+	}
+#endif
+	return first;
+}
+
+template<typename T, typename compare, size_t arity>
+void top_k<T, compare, arity>::merge(top_k& other)
+{
+	if (this == &other)
+	{
+		return;
+	}
+
+	// best first, so the threshold rises early and most of the rest is turned away
+	std::vector<T> elements = other.take_sorted();
+	for (T& element : elements)
+	{
+		if (!push(std::move(element)) && full())
+		{
+			break;
+		}
+	}
+}
+
+
+template<typename T, typename compare, size_t arity>
+inline const T& top_k<T, compare, arity>::threshold() const
+{
+	return heap.top();
+}
+
+template<typename T, typename compare, size_t arity>
+std::vector<T> top_k<T, compare, arity>::sorted() const
+{
+	priority_queue<T, reversed<T, compare>, arity> copy = heap;
+	std::vector<T> elements;
+	elements.reserve(copy.size());
+	copy.pop_n(copy.size(), std::back_inserter(elements));
+	std::reverse(elements.begin(), elements.end());
+	return elements;
+}
+
+template<typename T, typename compare, size_t arity>
+std::vector<T> top_k<T, compare, arity>::take_sorted()
+{
+	std::vector<T> elements;
+	elements.reserve(heap.size());
+	heap.pop_n(heap.size(), std::back_inserter(elements));
+	std::reverse(elements.begin(), elements.end());
+	return elements;
+}
+
+
+template<typename T, typename compare, size_t arity>
+inline bool top_k<T, compare, arity>::full() const
+{
+	return static_cast<size_t>(heap.size()) >= capacity;
+}
+
+template<typename T, typename compare, size_t arity>
+inline bool top_k<T, compare, arity>::empty() const
+{
+	return heap.empty();
+}
+
+template<typename T, typename compare, size_t arity>
+inline int top_k<T, compare, arity>::size() const
+{
+	return heap.size();
+}
+
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "priority_queue.cpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOP_K_USE_SSE2 1
+#endif
+
+// Keeps, out of a stream, the capacity elements a priority_queue<T, compare>
+// would pop first, in constant memory. They sit in a heap of the reversed
+// order, whose top is the worst element kept: anything not better than that
+// threshold is turned away with one compare, and anything better replaces it
+// with one sift_down.
+//
+// push_batch checks int32 and float elements against the threshold four at
+// a time with SSE2 (for less and greater) and only looks at the blocks that
+// hold a candidate. Partial results from several threads are combined with
+// merge.
+template <typename T, typename compare = greater<T>, size_t arity = 2>
+class top_k
+{
+private:
+	priority_queue<T, reversed<T, compare>, arity> heap;
+	size_t capacity;
+
+	// index of the first block of four after first that may hold a candidate
+	size_t skip_rejected(const T* elements, size_t first, size_t count) const;
+
+public:
+	explicit top_k(size_t capacity);
+
+	// true if element is among the best seen so far
+	bool push(T element);
+	void push_batch(const T* elements, size_t count);
+	// adds what other kept, other is left empty
+	void merge(top_k& other);
+
+	// the worst element kept; the selector must not be empty
+	const T& threshold() const;
+	// the elements kept, best first; sorted() keeps them, take_sorted() empties the selector
+	std::vector<T> sorted() const;
+	std::vector<T> take_sorted();
+
+	bool full() const;
+	bool empty() const;
+	int size() const;
+};
@@ -0,0 +1,782 @@
+#pragma once
+#include <iostream>
+#include <iterator>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BTREE_USE_SSE2 1
+#endif
+
+
+// Ordered map with the interface of map, stored as a B+-tree. A node holds as
+// many keys as fit in node_bytes (a few cache lines by default), keys and
+// values in separate arrays, so a lookup reads a handful of contiguous blocks
+// instead of one scattered node per level. All pairs live in the leaves, which
+// are chained left to right, so iterating is a sequential scan.
+//
+// For int32 and float keys under std::less, the position inside a node is
+// found with SSE2: the whole key array is compared against the searched key
+// four lanes at a time and the hits are counted, with no branches.
+//
+// Keys and values must be default constructible. Dereferencing an iterator
+// gives a pair of references, not a reference to a stored pair.
+template<typename keyT, typename valueT, typename cmp = std::less<keyT>, size_t node_bytes = 256>
+class btree_map
+{
+private:
+	static constexpr size_t leaf_capacity = (node_bytes - 32) / (sizeof(keyT) + sizeof(valueT)) > 4 ?
+		(node_bytes - 32) / (sizeof(keyT) + sizeof(valueT)) : 4;
+	static constexpr size_t inner_capacity = (node_bytes - 16) / (sizeof(keyT) + sizeof(void*)) > 4 ?
+		(node_bytes - 16) / (sizeof(keyT) + sizeof(void*)) - 1 : 4;
+
+	// deep enough for any tree that fits in memory with at least 3 children per inner node
+	static constexpr size_t max_depth = 64;
+
+	struct node_base
+	{
+		bool is_leaf;
+		size_t count;		// keys in the node
+	};
+
+	struct leaf_node : node_base
+	{
+		keyT keys[leaf_capacity];
+		valueT values[leaf_capacity];
+		leaf_node* next;
+	};
+
+	// child i holds the keys in [keys[i - 1], keys[i])
+	struct inner_node : node_base
+	{
+		keyT keys[inner_capacity];
+		node_base* children[inner_capacity + 1];
+	};
+
+	struct path_entry
+	{
+		inner_node* node;
+		size_t index;		// which child the path continues in
+	};
+
+public:
+	class iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::pair<const keyT, valueT>;
+		using reference = std::pair<const keyT&, valueT&>;
+
+		struct pointer
+		{
+			reference pair;
+			reference* operator->() { return &pair; }
+		};
+	private:
+		leaf_node* m_leaf;
+		size_t m_index;
+	public:
+		iterator();
+		iterator(leaf_node* leaf, size_t index);
+		reference operator*() const;
+		pointer operator->() const;
+		iterator& operator++();
+		iterator operator++(int);
+		bool operator==(const iterator& other) const;
+		bool operator!=(const iterator& other) const;
+
+		friend class btree_map;
+	};
+
+protected:
+	node_base* root;
+	leaf_node* first_leaf;
+	size_t m_size;
+
+public:
+	btree_map();
+	~btree_map();
+	btree_map(const btree_map& other);
+	btree_map& operator=(const btree_map& other);
+
+	iterator begin();
+	iterator end();
+
+	void insert(std::pair<keyT, valueT>);
+	valueT& operator[](keyT);
+
+	void erase(keyT key);
+	void erase(iterator it);
+	iterator find(keyT key);
+
+	void clear();
+
+	size_t size();
+	bool empty();
+
+protected:
+	static size_t count_less(const keyT* keys, size_t count, const keyT& key);
+	static size_t count_less_equal(const keyT* keys, size_t count, const keyT& key);
+
+	leaf_node* descend(const keyT& key, path_entry* path, size_t& depth);
+	valueT& insert_into(const keyT& key, bool& inserted);
+	void insert_into_parent(path_entry* path, size_t depth, const keyT& separator, node_base* right);
+	void fix_underflow(path_entry* path, size_t depth, node_base* current);
+
+	static node_base* clone(const node_base* other, leaf_node*& previous_leaf, leaf_node*& first);
+	static void destroy(node_base* current);
+};
+
+
+
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>::btree_map() : root(nullptr), first_leaf(nullptr), m_size(0) {}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>::~btree_map()
+{
+	clear();
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>::btree_map(const btree_map& other) : root(nullptr), first_leaf(nullptr), m_size(other.m_size)
+{
+	leaf_node* previous_leaf = nullptr;
+	if (other.root)
+	{
+		root = clone(other.root, previous_leaf, first_leaf);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>& btree_map<keyT, valueT, cmp, node_bytes>::operator=(const btree_map& other)
+{
+	if (this != &other)
+	{
+		clear();
+		leaf_node* previous_leaf = nullptr;
+		if (other.root)
+		{
+			root = clone(other.root, previous_leaf, first_leaf);
+		}
+		m_size = other.m_size;
+	}
+
+	return *this;
+}
+
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator btree_map<keyT, valueT, cmp, node_bytes>::begin()
+{
+	return m_size ? iterator(first_leaf, 0) : end();
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator btree_map<keyT, valueT, cmp, node_bytes>::end()
+{
+	return iterator(nullptr, 0);
+}
+
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline void btree_map<keyT, valueT, cmp, node_bytes>::insert(std::pair<keyT, valueT> key_value_pair)
+{
+	bool inserted;
+	valueT& current_value = insert_into(key_value_pair.first, inserted);
+
+	if (inserted)
+	{
+		current_value = std::move(key_value_pair.second);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline valueT& btree_map<keyT, valueT, cmp, node_bytes>::operator[](keyT key)
+{
+	bool inserted;
+	return insert_into(key, inserted);
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator btree_map<keyT, valueT, cmp, node_bytes>::find(keyT key)
+{
+	if (root == nullptr)
+	{
+		return end();
+	}
+
+	path_entry path[max_depth];
+	size_t depth;
+	leaf_node* leaf = descend(key, path, depth);
+	size_t index = count_less(leaf->keys, leaf->count, key);
+
+	if (index < leaf->count && !cmp()(key, leaf->keys[index]))
+	{
+		return iterator(leaf, index);
+	}
+	return end();
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+void btree_map<keyT, valueT, cmp, node_bytes>::erase(keyT key)
+{
+	if (root == nullptr)
+	{
+		return;
+	}
+
+	path_entry path[max_depth];
+	size_t depth;
+	leaf_node* leaf = descend(key, path, depth);
+	size_t index = count_less(leaf->keys, leaf->count, key);
+
+	if (index == leaf->count || cmp()(key, leaf->keys[index]))
+	{
+		return;
+	}
+
+	for (size_t position = index; position + 1 < leaf->count; ++position)
+	{
+		leaf->keys[position] = std::move(leaf->keys[position + 1]);
+		leaf->values[position] = std::move(leaf->values[position + 1]);
+	}
+	--leaf->count;
+	--m_size;
+
+	// the vacated slot keeps its old value alive until it is overwritten;
+	// give it a fresh one so resources are released now
+	leaf->keys[leaf->count] = keyT();
+	leaf->values[leaf->count] = valueT();
+
+	fix_underflow(path, depth, leaf);
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline void btree_map<keyT, valueT, cmp, node_bytes>::erase(iterator it)
+{
+	if (it.m_leaf)
+	{
+		erase(keyT(it.m_leaf->keys[it.m_index]));
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline void btree_map<keyT, valueT, cmp, node_bytes>::clear()
+{
+	if (root)
+	{
+		destroy(root);
+	}
+	root = nullptr;
+	first_leaf = nullptr;
+	m_size = 0;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline size_t btree_map<keyT, valueT, cmp, node_bytes>::size()
+{
+	return m_size;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline bool btree_map<keyT, valueT, cmp, node_bytes>::empty()
+{
+	return m_size == 0;
+}
+
+
+// Number of keys in keys[0, count) that compare less than key; since they
+// are sorted, that is also the lower bound of key.
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline size_t btree_map<keyT, valueT, cmp, node_bytes>::count_less(const keyT* keys, size_t count, const keyT& key)
+{
+	size_t index = 0;
+
+#ifdef BTREE_USE_SSE2
+	constexpr bool default_order = std::is_same<cmp, std::less<keyT>>::value || std::is_same<cmp, std::less<>>::value;
+
+	if constexpr (default_order && std::is_same<keyT, int32_t>::value)
+	{
+		__m128i needle = _mm_set1_epi32(key);
+		__m128i hits = _mm_setzero_si128();
+
+		for (; index + 4 <= count; index += 4)
+		{
+			// a true lane is -1, so subtracting the mask counts it
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + index));
+			hits = _mm_sub_epi32(hits, _mm_cmplt_epi32(block, needle));
+		}
+
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), hits);
+		size_t result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+		for (; index < count; ++index)
+		{
+			result += keys[index] < key;
+		}
+		return result;
+	}
+	else if constexpr (default_order && std::is_same<keyT, float>::value)
+	{
+		__m128 needle = _mm_set1_ps(key);
+		__m128i hits = _mm_setzero_si128();
+
+		for (; index + 4 <= count; index += 4)
+		{
+			__m128 block = _mm_loadu_ps(keys + index);
+			hits = _mm_sub_epi32(hits, _mm_castps_si128(_mm_cmplt_ps(block, needle)));
+		}
+
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128(reinterpret_cast<__m128i*>(lanes), hits);
+		size_t result = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+
+		for (; index < count; ++index)
+		{
+			result += keys[index] < key;
+		}
+		return result;
+	}
+#endif
+
+	// binary search for everything else
+	size_t high = count;
+	while (index < high)
+	{
+		size_t middle = index + (high - index) / 2;
+		if (cmp()(keys[middle], key))
+		{
+			index = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return index;
+}
+
+// Number of keys in keys[0, count) not greater than key (the upper bound).
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline size_t btree_map<keyT, valueT, cmp, node_bytes>::count_less_equal(const keyT* keys, size_t count, const keyT& key)
+{
+	size_t index = count_less(keys, count, key);
+
+	// keys are unique, so at most one equal key follows the lower bound
+	if (index < count && !cmp()(key, keys[index]))
+	{
+		++index;
+	}
+	return index;
+}
+
+
+// Walks from the root to the leaf that holds or would hold key, recording
+// the inner nodes passed and which child was taken in each.
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::leaf_node* btree_map<keyT, valueT, cmp, node_bytes>::descend(const keyT& key, path_entry* path, size_t& depth)
+{
+	node_base* current = root;
+	depth = 0;
+
+	while (!current->is_leaf)
+	{
+		inner_node* inner = static_cast<inner_node*>(current);
+		size_t index = count_less_equal(inner->keys, inner->count, key);
+
+		path[depth++] = { inner, index };
+		current = inner->children[index];
+	}
+	return static_cast<leaf_node*>(current);
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+valueT& btree_map<keyT, valueT, cmp, node_bytes>::insert_into(const keyT& key, bool& inserted)
+{
+	if (root == nullptr)
+	{
+		leaf_node* leaf = new leaf_node();
+		leaf->is_leaf = true;
+		leaf->count = 0;
+		leaf->next = nullptr;
+		root = first_leaf = leaf;
+	}
+
+	path_entry path[max_depth];
+	size_t depth;
+	leaf_node* leaf = descend(key, path, depth);
+	size_t index = count_less(leaf->keys, leaf->count, key);
+
+	if (index < leaf->count && !cmp()(key, leaf->keys[index]))
+	{
+		inserted = false;
+		return leaf->values[index];
+	}
+
+	inserted = true;
+	++m_size;
+
+	if (leaf->count == leaf_capacity)
+	{
+		// split off the upper half into a new leaf to the right
+		leaf_node* right = new leaf_node();
+		right->is_leaf = true;
+		size_t keep = leaf_capacity / 2;
+
+		right->count = leaf_capacity - keep;
+		for (size_t position = 0; position < right->count; ++position)
+		{
+			right->keys[position] = std::move(leaf->keys[keep + position]);
+			right->values[position] = std::move(leaf->values[keep + position]);
+		}
+		leaf->count = keep;
+		right->next = leaf->next;
+		leaf->next = right;
+
+		insert_into_parent(path, depth, right->keys[0], right);
+
+		if (index > keep)
+		{
+			leaf = right;
+			index -= keep;
+		}
+	}
+
+	for (size_t position = leaf->count; position > index; --position)
+	{
+		leaf->keys[position] = std::move(leaf->keys[position - 1]);
+		leaf->values[position] = std::move(leaf->values[position - 1]);
+	}
+	leaf->keys[index] = key;
+	leaf->values[index] = valueT();
+	++leaf->count;
+
+	return leaf->values[index];
+}
+
+// Adds separator and the node right of it to the inner node at the end of
+// path, splitting inner nodes on the way up as long as they are full.
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+void btree_map<keyT, valueT, cmp, node_bytes>::insert_into_parent(path_entry* path, size_t depth, const keyT& separator, node_base* right)
+{
+	keyT pending_key = separator;
+	node_base* pending_child = right;
+
+	while (depth > 0)
+	{
+		inner_node* parent = path[depth - 1].node;
+		size_t index = path[depth - 1].index;
+		--depth;
+
+		if (parent->count < inner_capacity)
+		{
+			for (size_t position = parent->count; position > index; --position)
+			{
+				parent->keys[position] = std::move(parent->keys[position - 1]);
+				parent->children[position + 1] = parent->children[position];
+			}
+			parent->keys[index] = std::move(pending_key);
+			parent->children[index + 1] = pending_child;
+			++parent->count;
+			return;
+		}
+
+		// full: lay out the keys and children with the new entry in place,
+		// then the middle key moves up and the rest is split in two
+		keyT keys[inner_capacity + 1];
+		node_base* children[inner_capacity + 2];
+
+		for (size_t position = 0, source = 0; position <= inner_capacity; ++position)
+		{
+			keys[position] = position == index ? std::move(pending_key) : std::move(parent->keys[source++]);
+		}
+		for (size_t position = 0, source = 0; position <= inner_capacity + 1; ++position)
+		{
+			children[position] = position == index + 1 ? pending_child : parent->children[source++];
+		}
+
+		size_t middle = (inner_capacity + 1) / 2;
+		inner_node* sibling = new inner_node();
+		sibling->is_leaf = false;
+
+		parent->count = middle;
+		for (size_t position = 0; position < middle; ++position)
+		{
+			parent->keys[position] = std::move(keys[position]);
+			parent->children[position] = children[position];
+		}
+		parent->children[middle] = children[middle];
+
+		sibling->count = inner_capacity - middle;
+		for (size_t position = 0; position < sibling->count; ++position)
+		{
+			sibling->keys[position] = std::move(keys[middle + 1 + position]);
+			sibling->children[position] = children[middle + 1 + position];
+		}
+		sibling->children[sibling->count] = children[inner_capacity + 1];
+
+		pending_key = std::move(keys[middle]);
+		pending_child = sibling;
+	}
+
+	// the root itself was split
+	inner_node* new_root = new inner_node();
+	new_root->is_leaf = false;
+	new_root->count = 1;
+	new_root->keys[0] = std::move(pending_key);
+	new_root->children[0] = root;
+	new_root->children[1] = pending_child;
+	root = new_root;
+}
+
+// Restores the minimum fill of current, the node at the end of path, by
+// borrowing from a sibling or merging with it; a merge takes a key out of
+// the parent, which may then need the same treatment.
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+void btree_map<keyT, valueT, cmp, node_bytes>::fix_underflow(path_entry* path, size_t depth, node_base* current)
+{
+	while (depth > 0)
+	{
+		size_t minimum = current->is_leaf ? leaf_capacity / 2 : inner_capacity / 2;
+		if (current->count >= minimum)
+		{
+			return;
+		}
+
+		inner_node* parent = path[depth - 1].node;
+		size_t index = path[depth - 1].index;
+		--depth;
+
+		node_base* left = index > 0 ? parent->children[index - 1] : nullptr;
+		node_base* right = index < parent->count ? parent->children[index + 1] : nullptr;
+
+		if (current->is_leaf)
+		{
+			leaf_node* leaf = static_cast<leaf_node*>(current);
+			leaf_node* left_leaf = static_cast<leaf_node*>(left);
+			leaf_node* right_leaf = static_cast<leaf_node*>(right);
+
+			if (left_leaf && left_leaf->count > minimum)
+			{
+				for (size_t position = leaf->count; position > 0; --position)
+				{
+					leaf->keys[position] = std::move(leaf->keys[position - 1]);
+					leaf->values[position] = std::move(leaf->values[position - 1]);
+				}
+				--left_leaf->count;
+				leaf->keys[0] = std::move(left_leaf->keys[left_leaf->count]);
+				leaf->values[0] = std::move(left_leaf->values[left_leaf->count]);
+				++leaf->count;
+				parent->keys[index - 1] = leaf->keys[0];
+				return;
+			}
+			if (right_leaf && right_leaf->count > minimum)
+			{
+				leaf->keys[leaf->count] = std::move(right_leaf->keys[0]);
+				leaf->values[leaf->count] = std::move(right_leaf->values[0]);
+				++leaf->count;
+				for (size_t position = 0; position + 1 < right_leaf->count; ++position)
+				{
+					right_leaf->keys[position] = std::move(right_leaf->keys[position + 1]);
+					right_leaf->values[position] = std::move(right_leaf->values[position + 1]);
+				}
+				--right_leaf->count;
+				parent->keys[index] = right_leaf->keys[0];
+				return;
+			}
+
+			// merge the right one of the pair into the left one
+			if (left_leaf)
+			{
+				right_leaf = leaf;
+				leaf = left_leaf;
+				--index;
+			}
+			for (size_t position = 0; position < right_leaf->count; ++position)
+			{
+				leaf->keys[leaf->count + position] = std::move(right_leaf->keys[position]);
+				leaf->values[leaf->count + position] = std::move(right_leaf->values[position]);
+			}
+			leaf->count += right_leaf->count;
+			leaf->next = right_leaf->next;
+			delete right_leaf;
+		}
+		else
+		{
+			inner_node* inner = static_cast<inner_node*>(current);
+			inner_node* left_inner = static_cast<inner_node*>(left);
+			inner_node* right_inner = static_cast<inner_node*>(right);
+
+			if (left_inner && left_inner->count > minimum)
+			{
+				inner->children[inner->count + 1] = inner->children[inner->count];
+				for (size_t position = inner->count; position > 0; --position)
+				{
+					inner->keys[position] = std::move(inner->keys[position - 1]);
+					inner->children[position] = inner->children[position - 1];
+				}
+				inner->keys[0] = std::move(parent->keys[index - 1]);
+				inner->children[0] = left_inner->children[left_inner->count];
+				++inner->count;
+				--left_inner->count;
+				parent->keys[index - 1] = std::move(left_inner->keys[left_inner->count]);
+				return;
+			}
+			if (right_inner && right_inner->count > minimum)
+			{
+				inner->keys[inner->count] = std::move(parent->keys[index]);
+				inner->children[inner->count + 1] = right_inner->children[0];
+				++inner->count;
+				parent->keys[index] = std::move(right_inner->keys[0]);
+				for (size_t position = 0; position + 1 < right_inner->count; ++position)
+				{
+					right_inner->keys[position] = std::move(right_inner->keys[position + 1]);
+					right_inner->children[position] = right_inner->children[position + 1];
+				}
+				right_inner->children[right_inner->count - 1] = right_inner->children[right_inner->count];
+				--right_inner->count;
+				return;
+			}
+
+			if (left_inner)
+			{
+				right_inner = inner;
+				inner = left_inner;
+				--index;
+			}
+			inner->keys[inner->count] = std::move(parent->keys[index]);
+			for (size_t position = 0; position < right_inner->count; ++position)
+			{
+				inner->keys[inner->count + 1 + position] = std::move(right_inner->keys[position]);
+				inner->children[inner->count + 1 + position] = right_inner->children[position];
+			}
+			inner->children[inner->count + 1 + right_inner->count] = right_inner->children[right_inner->count];
+			inner->count += right_inner->count + 1;
+			delete right_inner;
+		}
+
+		// drop the separator between the merged pair and the pointer to the right one
+		for (size_t position = index; position + 1 < parent->count; ++position)
+		{
+			parent->keys[position] = std::move(parent->keys[position + 1]);
+			parent->children[position + 1] = parent->children[position + 2];
+		}
+		--parent->count;
+		current = parent;
+	}
+
+	// an inner root left with a single child hands the root over to it
+	if (!root->is_leaf && root->count == 0)
+	{
+		inner_node* old_root = static_cast<inner_node*>(root);
+		root = old_root->children[0];
+		delete old_root;
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+typename btree_map<keyT, valueT, cmp, node_bytes>::node_base* btree_map<keyT, valueT, cmp, node_bytes>::clone(const node_base* other, leaf_node*& previous_leaf, leaf_node*& first)
+{
+	if (other->is_leaf)
+	{
+		leaf_node* leaf = new leaf_node(*static_cast<const leaf_node*>(other));
+		leaf->next = nullptr;
+
+		// leaves are reached left to right, so each links to the one before
+		if (previous_leaf)
+		{
+			previous_leaf->next = leaf;
+		}
+		else
+		{
+			first = leaf;
+		}
+		previous_leaf = leaf;
+		return leaf;
+	}
+
+	const inner_node* other_inner = static_cast<const inner_node*>(other);
+	inner_node* inner = new inner_node(*other_inner);
+
+	for (size_t index = 0; index <= inner->count; ++index)
+	{
+		inner->children[index] = clone(other_inner->children[index], previous_leaf, first);
+	}
+	return inner;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+void btree_map<keyT, valueT, cmp, node_bytes>::destroy(node_base* current)
+{
+	if (current->is_leaf)
+	{
+		delete static_cast<leaf_node*>(current);
+		return;
+	}
+
+	inner_node* inner = static_cast<inner_node*>(current);
+	for (size_t index = 0; index <= inner->count; ++index)
+	{
+		destroy(inner->children[index]);
+	}
+	delete inner;
+}
+
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>::iterator::iterator() : m_leaf(nullptr), m_index(0) {}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline btree_map<keyT, valueT, cmp, node_bytes>::iterator::iterator(leaf_node* leaf, size_t index) : m_leaf(leaf), m_index(index) {}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator::reference btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator*() const
+{
+	return reference(m_leaf->keys[m_index], m_leaf->values[m_index]);
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator::pointer btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator->() const
+{
+	return pointer{ **this };
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator& btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator++()
+{
+	if (++m_index == m_leaf->count)
+	{
+		m_leaf = m_leaf->next;
+		m_index = 0;
+	}
+	return *this;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline typename btree_map<keyT, valueT, cmp, node_bytes>::iterator btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator++(int)
+{
+	iterator tmp = *this;
+	++(*this);
+	return tmp;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline bool btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator==(const iterator& other) const
+{
+	return m_leaf == other.m_leaf && m_index == other.m_index;
+}
+
+template<typename keyT, typename valueT, typename cmp, size_t node_bytes>
+inline bool btree_map<keyT, valueT, cmp, node_bytes>::iterator::operator!=(const iterator& other) const
+{
+	return !(*this == other);
+}
@@ -0,0 +1,460 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include "../memory/epoch.h"
+
+
+// Thread-safe ordered map: a lazy skip list (Herlihy, Lev, Luchangco, Shavit).
+// Readers take no lock at all; they walk the levels under an epoch_guard and
+// trust a node once it is fully linked and not marked. Writers lock only the
+// nodes right around the key they change and check that nothing moved in the
+// meantime, so writes to distinct keys proceed side by side. find, insert,
+// insert_or_assign and erase are linearizable.
+//
+// A value lives in a box of its own: assigning swaps in a fresh box, and the
+// old box, like every unlinked node, is retired to the epoch domain.
+//
+// for_each_in_range is weakly consistent: it sees every key that is present
+// for the whole scan, and may or may not see keys changed during it.
+//
+// There is no operator[]: a reference into the map could outlive the value.
+template<typename keyT, typename valueT, typename cmp = std::less<keyT>>
+class concurrent_map
+{
+private:
+	static constexpr int max_level = 32;
+
+	struct node;
+
+	// the head is a tower without a key, every other tower is a node
+	struct tower
+	{
+		std::mutex lock;
+		const int levels;
+		std::atomic<bool> marked;			// logically removed, set by erase under lock
+		std::atomic<bool> fully_linked;		// linked on every level, set by insert
+		std::atomic<node*>* const next;
+
+		tower(int levels, std::atomic<node*>* next);
+	};
+
+	struct node : tower
+	{
+		const keyT key;
+		std::atomic<valueT*> value;
+
+		node(int levels, std::atomic<node*>* next, const std::pair<keyT, valueT>& pair);
+		~node();
+	};
+
+	std::atomic<node*> head_next[max_level];
+	tower head;
+	std::atomic<size_t> number_of_pairs;
+
+	// a node and its next pointers share one allocation, so a step along a
+	// level touches a single cache line
+	static node* create_node(int levels, const std::pair<keyT, valueT>& pair);
+	static void destroy_node(void* pointer);
+	static int random_levels();
+	// highest level key was found on, -1 if it was not; fills in the
+	// neighbours of key on every level either way
+	int search(const keyT& key, tower** preds, node** succs) const;
+	// locks the distinct preds of the lowest levels, bottom up, and checks they
+	// still link to succs; on failure everything is unlocked again
+	static bool lock_and_validate(tower** preds, node** succs, int levels, bool unmarked_succs);
+	static void unlock(tower** preds, int levels);
+	// waits for an insert still linking found; false if found is being erased
+	static bool settle(node* found);
+
+public:
+	concurrent_map();
+	~concurrent_map();
+	concurrent_map(const concurrent_map&) = delete;
+	concurrent_map& operator=(const concurrent_map&) = delete;
+
+	bool insert(const std::pair<keyT, valueT>& pair);
+	void insert_or_assign(const std::pair<keyT, valueT>& pair);
+	bool erase(const keyT& key);
+
+	bool find(const keyT& key) const;
+	valueT get_value(const keyT& key) const;
+	bool try_get_value(const keyT& key, valueT& result) const;
+
+	// calls visit(key, value) for keys in [low, high] in order
+	template<typename visitor>
+	void for_each_in_range(const keyT& low, const keyT& high, visitor&& visit) const;
+
+	size_t size() const;
+	bool empty() const;
+};
+
+
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline concurrent_map<keyT, valueT, cmp>::tower::tower(int levels, std::atomic<node*>* next) :
+	levels(levels), marked(false), fully_linked(false), next(next)
+{
+	for (int level = 0; level < levels; ++level)
+	{
+		next[level].store(nullptr, std::memory_order_relaxed);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline concurrent_map<keyT, valueT, cmp>::node::node(int levels, std::atomic<node*>* next, const std::pair<keyT, valueT>& pair) :
+	tower(levels, next), key(pair.first), value(new valueT(pair.second)) {}
+
+template<typename keyT, typename valueT, typename cmp>
+inline concurrent_map<keyT, valueT, cmp>::node::~node()
+{
+	delete value.load(std::memory_order_relaxed);
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline concurrent_map<keyT, valueT, cmp>::concurrent_map() : head(max_level, head_next), number_of_pairs(0) {}
+
+template<typename keyT, typename valueT, typename cmp>
+inline concurrent_map<keyT, valueT, cmp>::~concurrent_map()
+{
+	node* current_node = head.next[0].load();
+	while (current_node)
+	{
+		node* next = current_node->next[0].load();
+		destroy_node(current_node);
+		current_node = next;
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline typename concurrent_map<keyT, valueT, cmp>::node* concurrent_map<keyT, valueT, cmp>::create_node(int levels, const std::pair<keyT, valueT>& pair)
+{
+	char* memory = static_cast<char*>(::operator new(sizeof(node) + levels * sizeof(std::atomic<node*>)));
+	return new (memory) node(levels, reinterpret_cast<std::atomic<node*>*>(memory + sizeof(node)), pair);
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline void concurrent_map<keyT, valueT, cmp>::destroy_node(void* pointer)
+{
+	static_cast<node*>(pointer)->~node();
+	::operator delete(pointer);
+}
+
+
+// Geometric with p = 1/2, from a per-thread xorshift generator.
+template<typename keyT, typename valueT, typename cmp>
+inline int concurrent_map<keyT, valueT, cmp>::random_levels()
+{
+	thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+
+	int levels = 1;
+	for (uint64_t bits = state; (bits & 1) && levels < max_level; bits >>= 1)
+	{
+		++levels;
+	}
+	return levels;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+int concurrent_map<keyT, valueT, cmp>::search(const keyT& key, tower** preds, node** succs) const
+{
+	int found = -1;
+	tower* pred = const_cast<tower*>(&head);
+
+	for (int level = max_level - 1; level >= 0; --level)
+	{
+		node* current_node = pred->next[level].load(std::memory_order_acquire);
+		while (current_node && cmp()(current_node->key, key))
+		{
+			pred = current_node;
+			current_node = pred->next[level].load(std::memory_order_acquire);
+		}
+
+		if (found == -1 && current_node && !cmp()(key, current_node->key))
+		{
+			found = level;
+		}
+		preds[level] = pred;
+		succs[level] = current_node;
+	}
+	return found;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+bool concurrent_map<keyT, valueT, cmp>::lock_and_validate(tower** preds, node** succs, int levels, bool unmarked_succs)
+{
+	tower* previous = nullptr;
+
+	for (int level = 0; level < levels; ++level)
+	{
+		tower* pred = preds[level];
+		if (pred != previous)
+		{
+			pred->lock.lock();
+			previous = pred;
+		}
+
+		node* succ = succs[level];
+		if (pred->marked.load(std::memory_order_relaxed) ||
+			(unmarked_succs && succ && succ->marked.load(std::memory_order_relaxed)) ||
+			pred->next[level].load(std::memory_order_relaxed) != succ)
+		{
+			unlock(preds, level + 1);
+			return false;
+		}
+	}
+	return true;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline void concurrent_map<keyT, valueT, cmp>::unlock(tower** preds, int levels)
+{
+	tower* previous = nullptr;
+
+	for (int level = 0; level < levels; ++level)
+	{
+		if (preds[level] != previous)
+		{
+			preds[level]->lock.unlock();
+			previous = preds[level];
+		}
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool concurrent_map<keyT, valueT, cmp>::settle(node* found)
+{
+	if (found->marked.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	while (!found->fully_linked.load(std::memory_order_acquire))
+	{
+		std::this_thread::yield();
+	}
+	return true;
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+bool concurrent_map<keyT, valueT, cmp>::insert(const std::pair<keyT, valueT>& pair)
+{
+	int levels = random_levels();
+	tower* preds[max_level];
+	node* succs[max_level];
+	epoch_guard guard;
+
+	for (;;)
+	{
+		int found = search(pair.first, preds, succs);
+		if (found != -1)
+		{
+			if (settle(succs[found]))
+			{
+				return false;
+			}
+			// the key is on its way out; try again once it is unlinked
+			continue;
+		}
+
+		if (!lock_and_validate(preds, succs, levels, true))
+		{
+			continue;
+		}
+
+		node* new_node = create_node(levels, pair);
+		for (int level = 0; level < levels; ++level)
+		{
+			new_node->next[level].store(succs[level], std::memory_order_relaxed);
+		}
+		for (int level = 0; level < levels; ++level)
+		{
+			preds[level]->next[level].store(new_node, std::memory_order_release);
+		}
+		new_node->fully_linked.store(true, std::memory_order_release);
+
+		unlock(preds, levels);
+		number_of_pairs.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp>
+void concurrent_map<keyT, valueT, cmp>::insert_or_assign(const std::pair<keyT, valueT>& pair)
+{
+	tower* preds[max_level];
+	node* succs[max_level];
+	epoch_guard guard;
+
+	for (;;)
+	{
+		int found = search(pair.first, preds, succs);
+		if (found == -1)
+		{
+			if (insert(pair))
+			{
+				return;
+			}
+			continue;
+		}
+
+		node* current_node = succs[found];
+		if (!settle(current_node))
+		{
+			continue;
+		}
+
+		// under the node's lock erase cannot mark it between the check and the swap
+		std::lock_guard<std::mutex> lock(current_node->lock);
+		if (current_node->marked.load(std::memory_order_relaxed))
+		{
+			continue;
+		}
+		valueT* old_value = current_node->value.exchange(new valueT(pair.second), std::memory_order_acq_rel);
+		epoch_domain::global().retire(old_value);
+		return;
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp>
+bool concurrent_map<keyT, valueT, cmp>::erase(const keyT& key)
+{
+	tower* preds[max_level];
+	node* succs[max_level];
+	node* victim = nullptr;
+	epoch_guard guard;
+
+	for (;;)
+	{
+		int found = search(key, preds, succs);
+
+		if (!victim)
+		{
+			// only a node that is fully linked, and found on its top level,
+			// is settled enough to be taken out
+			if (found == -1)
+			{
+				return false;
+			}
+			node* candidate = succs[found];
+			if (!candidate->fully_linked.load(std::memory_order_acquire) || candidate->levels - 1 != found ||
+				candidate->marked.load(std::memory_order_acquire))
+			{
+				return false;
+			}
+
+			candidate->lock.lock();
+			if (candidate->marked.load(std::memory_order_relaxed))
+			{
+				candidate->lock.unlock();
+				return false;
+			}
+			candidate->marked.store(true, std::memory_order_release);
+			victim = candidate;
+		}
+
+		// the key is erased from here on; what is left is unlinking the victim
+		if (!lock_and_validate(preds, succs, victim->levels, false))
+		{
+			continue;
+		}
+
+		for (int level = victim->levels - 1; level >= 0; --level)
+		{
+			preds[level]->next[level].store(victim->next[level].load(std::memory_order_relaxed), std::memory_order_release);
+		}
+
+		victim->lock.unlock();
+		unlock(preds, victim->levels);
+		number_of_pairs.fetch_sub(1, std::memory_order_relaxed);
+		epoch_domain::global().retire(victim, destroy_node);
+		return true;
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool concurrent_map<keyT, valueT, cmp>::find(const keyT& key) const
+{
+	tower* preds[max_level];
+	node* succs[max_level];
+	epoch_guard guard;
+
+	int found = search(key, preds, succs);
+	return found != -1 && succs[found]->fully_linked.load(std::memory_order_acquire) && !succs[found]->marked.load(std::memory_order_acquire);
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline valueT concurrent_map<keyT, valueT, cmp>::get_value(const keyT& key) const
+{
+	valueT result = valueT();
+	try_get_value(key, result);
+	return result;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+bool concurrent_map<keyT, valueT, cmp>::try_get_value(const keyT& key, valueT& result) const
+{
+	tower* preds[max_level];
+	node* succs[max_level];
+	epoch_guard guard;
+
+	int found = search(key, preds, succs);
+	if (found == -1 || !succs[found]->fully_linked.load(std::memory_order_acquire) || succs[found]->marked.load(std::memory_order_acquire))
+	{
+		return false;
+	}
+	result = *succs[found]->value.load(std::memory_order_acquire);
+	return true;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+template<typename visitor>
+void concurrent_map<keyT, valueT, cmp>::for_each_in_range(const keyT& low, const keyT& high, visitor&& visit) const
+{
+	epoch_guard guard;
+	const tower* pred = &head;
+
+	for (int level = max_level - 1; level >= 0; --level)
+	{
+		node* current_node = pred->next[level].load(std::memory_order_acquire);
+		while (current_node && cmp()(current_node->key, low))
+		{
+			pred = current_node;
+			current_node = pred->next[level].load(std::memory_order_acquire);
+		}
+	}
+
+	// an erased node keeps its successors, so the walk can always go on from it
+	for (node* current_node = pred->next[0].load(std::memory_order_acquire); current_node && !cmp()(high, current_node->key);
+		current_node = current_node->next[0].load(std::memory_order_acquire))
+	{
+		if (current_node->fully_linked.load(std::memory_order_acquire) && !current_node->marked.load(std::memory_order_acquire))
+		{
+			visit(current_node->key, *current_node->value.load(std::memory_order_acquire));
+		}
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline size_t concurrent_map<keyT, valueT, cmp>::size() const
+{
+	return number_of_pairs.load(std::memory_order_relaxed);
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool concurrent_map<keyT, valueT, cmp>::empty() const
+{
+	return size() == 0;
+}
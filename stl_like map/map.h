@@ -5,8 +5,20 @@
 #include <queue>
 #include <iterator>
 #include <cstddef>
-
-template<typename keyT, typename valueT, typename cmp = std::less<keyT>>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <algorithm>
+#include "../memory/node_pool.h"
+#include "../parallel/parallel_sort.h"
+#include "../parallel/fork_join.h"
+
+// allocator is rebound to the node type; pool_allocator (memory/node_pool.h)
+// keeps the nodes in slabs and frees them all at once on clear().
+template<typename keyT, typename valueT, typename cmp = std::less<keyT>, typename allocator = std::allocator<std::pair<const keyT, valueT>>>
 class map
 {
 public:
@@ -14,25 +26,29 @@ public:
 	{
 	public:
 		int height;
+		size_t size;	// nodes in this subtree
 		std::pair<const keyT, valueT> key_value_pair;
 		node* parent, * left, * right;
 
-		node(std::pair<keyT, valueT>key_value_pair, node* parent = nullptr, int height = 0) :
-			key_value_pair(key_value_pair), parent(parent), height(height),
-			left(nullptr), right(nullptr) {}
+		// the pair is built in place from pair_arguments
+		template<typename... arguments>
+		explicit node(node* parent, arguments&&... pair_arguments) :
+			height(0), size(1), key_value_pair(std::forward<arguments>(pair_arguments)...),
+			parent(parent), left(nullptr), right(nullptr) {}
 
 		int balance_factor();
 		void recalculate_height();
+		void recalculate_size();
 	};
 
 	class iterator
 	{
 	public:
-		using iterator_category = std::forward_iterator_tag;
+		using iterator_category = std::bidirectional_iterator_tag;
 		using difference_type = std::ptrdiff_t;
 		using value_type = std::pair<const keyT, valueT>;
 		using pointer = value_type*;
-		using reference = value_type;
+		using reference = value_type&;
 	private:
 		node* m_node;
 		map* m_map;
@@ -43,31 +59,129 @@ public:
 		pointer operator->();
 		iterator& operator++();
 		iterator operator++(int);
-		bool operator==(const iterator& other);
-		bool operator!=(const iterator& other);
+		// decrementing end() gives the largest key
+		iterator& operator--();
+		iterator operator--(int);
+		bool operator==(const iterator& other) const;
+		bool operator!=(const iterator& other) const;
 
 		friend class map;
 	};
 
 protected:
+	using node_allocator = typename std::allocator_traits<allocator>::template rebind_alloc<node>;
+
+public:
+	// Owns a node taken out of a map by extract(). Inserting it into a map
+	// with an equal allocator relinks the node without allocating; a handle
+	// that is dropped frees its node. Only a handle that owns a node holds an
+	// allocator, so empty ones (a failed extract) never create a pool.
+	class node_handle
+	{
+	private:
+		node* m_node;
+		std::optional<node_allocator> alloc;
+
+		node_handle(node* some_node, const node_allocator& alloc) : m_node(some_node), alloc(alloc) {}
+		void reset();
+	public:
+		node_handle() : m_node(nullptr) {}
+		node_handle(node_handle&& other);
+		node_handle& operator=(node_handle&& other);
+		~node_handle();
+
+		bool empty() const { return m_node == nullptr; }
+		explicit operator bool() const { return m_node != nullptr; }
+		const keyT& key() const { return m_node->key_value_pair.first; }
+		valueT& mapped() const { return m_node->key_value_pair.second; }
+
+		friend class map;
+	};
+
+protected:
+
 	node* root;
 	size_t m_size;
+	node_allocator alloc;
 
 public:
 	map();
+	explicit map(const allocator& alloc);
+	// O(n) from a range sorted by key; other ranges are sorted first
+	template<typename iterator_type>
+	map(iterator_type first, iterator_type last, const allocator& alloc = allocator());
 	~map();
 	map(const map& other);
 	map& operator=(const map& other);
+	// other is left empty
+	map(map&& other);
+	map& operator=(map&& other);
+
+	using reverse_iterator = std::reverse_iterator<iterator>;
 
 	iterator begin();
 	iterator end();
-
-	void insert(std::pair<keyT, valueT>);
-	valueT& operator[](keyT);
-
-	void erase(keyT key);
+	reverse_iterator rbegin();
+	reverse_iterator rend();
+
+	// All insertions leave an existing key and its value as they are, except
+	// insert_or_assign, and return the entry for the key together with
+	// whether it was added.
+	std::pair<iterator, bool> insert(const std::pair<keyT, valueT>& key_value_pair);
+	std::pair<iterator, bool> insert(std::pair<keyT, valueT>&& key_value_pair);
+	// builds the pair in place from arguments; the node is freed again if the key exists
+	template<typename... arguments>
+	std::pair<iterator, bool> emplace(arguments&&... pair_arguments);
+	// builds the value from arguments only if key is missing
+	template<typename... arguments>
+	std::pair<iterator, bool> try_emplace(const keyT& key, arguments&&... value_arguments);
+	template<typename... arguments>
+	std::pair<iterator, bool> try_emplace(keyT&& key, arguments&&... value_arguments);
+	template<typename mappedT>
+	std::pair<iterator, bool> insert_or_assign(const keyT& key, mappedT&& value);
+	template<typename mappedT>
+	std::pair<iterator, bool> insert_or_assign(keyT&& key, mappedT&& value);
+	valueT& operator[](const keyT& key);
+	valueT& operator[](keyT&& key);
+
+	// takes the node out of the map without freeing it; an empty handle if key is missing
+	node_handle extract(iterator it);
+	node_handle extract(const keyT& key);
+	// if the key exists, handle keeps its node and the existing entry is returned
+	std::pair<iterator, bool> insert(node_handle&& handle);
+
+	void erase(const keyT& key);
 	void erase(iterator it);
-	iterator find(keyT key);
+	iterator find(const keyT& key);
+
+	// first key not less than key / first key greater than key, end() if none
+	iterator lower_bound(const keyT& key);
+	iterator upper_bound(const keyT& key);
+	std::pair<iterator, iterator> equal_range(const keyT& key);
+	// calls visit(pair) for every key in [low, high] in order, in O(log n + k)
+	template<typename visitor>
+	void for_each_in_range(const keyT& low, const keyT& high, visitor&& visit);
+
+	// keys that compare less than key
+	size_t rank(const keyT& key);
+	// iterator to the k-th smallest key counting from 0, end() if there are not that many
+	iterator select(size_t k);
+	// keys in [low, high]
+	size_t count_range(const keyT& low, const keyT& high);
+
+	// Join-based operations, as on AVL: nodes are relinked rather than
+	// inserted, the set operations run on both halves in parallel, and for a
+	// key in both maps the value already here is kept.
+
+	// keys >= key move into greater, replacing what it held
+	void split(const keyT& key, map& greater);
+	// appends key_value_pair and all of right; keys here < its key < keys in right
+	void join(const std::pair<keyT, valueT>& key_value_pair, map& right);
+	void join(map& right);
+	// other is left empty
+	void union_with(map& other);
+	void intersect_with(map& other);
+	void difference_with(map& other);
 
 	void clear();
 
@@ -77,13 +191,53 @@ public:
 protected:
 
 	void rebalance_insert(node*);
+	// node with key, or nullptr and parent set to the node a new key goes under
+	node* locate(const keyT& key, node*& parent);
+	// links a detached node in under parent, as found by locate
+	void attach(node* new_node, node* parent);
+	// takes this_node out of the tree without freeing it
+	void unlink(node* this_node);
+	void update_sizes(node* from);
+	size_t count_below(const keyT& key, bool inclusive);
+	node* bound(const keyT& key, bool inclusive);
+	template<typename visitor>
+	void visit_range(node* subtree, const keyT& low, const keyT& high, visitor& visit);
+
+	static constexpr size_t parallel_grain = 1 << 14;
+
+	static int subtree_height(node* subtree);
+	static size_t subtree_size(node* subtree);
+	static node* make_node(node* left, node* middle, node* right);
+	static node* rotate_left_subtree(node* subtree);
+	static node* rotate_right_subtree(node* subtree);
+	static node* join_right(node* left, node* middle, node* right);
+	static node* join_left(node* left, node* middle, node* right);
+	static node* join_nodes(node* left, node* middle, node* right);
+	static node* join_nodes(node* left, node* right);
+	static void split_nodes(node* tree, const keyT& key, bool inclusive, node*& left, node*& right);
+	static void split_first(node* tree, node*& first, node*& rest);
+	static void collect(node* subtree, std::vector<node*>& nodes);
+	static node* union_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+	static node* intersect_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+	static node* difference_nodes(node* first, node* second, std::vector<node*>& dropped, int depth);
+
+	void set_root(node* new_root);
+	void adopt(map& other);
+	void destroy_nodes(std::vector<node*>& nodes);
 
 	void rotate_left(node*);
 	void rotate_right(node*);
 
 	void init(const map& other);
+	void release();
+	void build(std::vector<std::pair<keyT, valueT>>& pairs);
+	static int balanced_height(size_t size);
 	void erase(node* node);
 
+	template<typename... arguments>
+	node* create_node(node* parent, arguments&&... pair_arguments);
+	void destroy_node(node* node);
+
 	node* max(node* root);
 	node* min(node* root);
 
@@ -94,166 +248,336 @@ protected:
 
 
 
-template<typename keyT, typename valueT, typename cmp>
-map<keyT, valueT, cmp>::map() : root(nullptr), m_size(0) {}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>::map() : root(nullptr), m_size(0) {}
 
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>::map(const allocator& alloc) : root(nullptr), m_size(0), alloc(alloc) {}
 
 
-template<typename keyT, typename valueT, typename cmp>
-map<keyT, valueT, cmp>::~map()
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename iterator_type>
+map<keyT, valueT, cmp, allocator>::map(iterator_type first, iterator_type last, const allocator& alloc) : root(nullptr), m_size(0), alloc(alloc)
 {
-	if (root)
-	{
-		std::queue<node*> q;
-		q.push(root);
+	std::vector<std::pair<keyT, valueT>> pairs(first, last);
+	build(pairs);
+}
 
-		while (!q.empty())
-		{
-			if (q.front()->right)
-			{
-				q.push(q.front()->right);
-			}
-			if (q.front()->left)
-			{
-				q.push(q.front()->left);
-			}
-			delete q.front();
-			q.pop();
-		}
-		root = nullptr;
-	}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>::~map()
+{
+	release();
 }
 
-template<typename keyT, typename valueT, typename cmp>
-map<keyT, valueT, cmp>::map(const map& other)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>::map(const map& other) :
+	alloc(std::allocator_traits<node_allocator>::select_on_container_copy_construction(other.alloc))
 {
 	init(other);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-map<keyT, valueT, cmp>& map<keyT, valueT, cmp>::operator=(const map& other)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>& map<keyT, valueT, cmp, allocator>::operator=(const map& other)
 {
-	if (root) this->~map();
-	init(other);
+	if (this != &other)
+	{
+		release();
+		init(other);
+	}
 
 	return *this;
 }
 
-template<typename keyT, typename valueT, typename cmp>
-inline  typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::begin()
+// The allocator is copied rather than moved, so the emptied map can still
+// allocate; with pool_allocator both maps share the pool.
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>::map(map&& other) : root(other.root), m_size(other.m_size), alloc(other.alloc)
+{
+	other.root = nullptr;
+	other.m_size = 0;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+map<keyT, valueT, cmp, allocator>& map<keyT, valueT, cmp, allocator>::operator=(map&& other)
+{
+	if (this == &other)
+	{
+		return *this;
+	}
+
+	release();
+	if (std::allocator_traits<node_allocator>::propagate_on_container_move_assignment::value)
+	{
+		alloc = other.alloc;
+	}
+
+	if (alloc == other.alloc)
+	{
+		root = other.root;
+		m_size = other.m_size;
+		other.root = nullptr;
+		other.m_size = 0;
+	}
+	else
+	{
+		// nodes cannot change allocators, only their values can be moved over
+		std::vector<std::pair<keyT, valueT>> pairs;
+		pairs.reserve(other.m_size);
+		for (node* current_node = other.min(other.root); current_node; current_node = other.succ(current_node))
+		{
+			pairs.emplace_back(current_node->key_value_pair.first, std::move(current_node->key_value_pair.second));
+		}
+		other.release();
+		build(pairs);
+	}
+
+	return *this;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline  typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::begin()
 {
 	return iterator(min(root), this);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-inline  typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::end()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline  typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::end()
 {
 	return iterator(nullptr, this);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::insert(std::pair<keyT, valueT> key_value_pair)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline typename map<keyT, valueT, cmp, allocator>::reverse_iterator map<keyT, valueT, cmp, allocator>::rbegin()
 {
-	if (root == nullptr)
+	return reverse_iterator(end());
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline typename map<keyT, valueT, cmp, allocator>::reverse_iterator map<keyT, valueT, cmp, allocator>::rend()
+{
+	return reverse_iterator(begin());
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::insert(const std::pair<keyT, valueT>& key_value_pair)
+{
+	return try_emplace(key_value_pair.first, key_value_pair.second);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::insert(std::pair<keyT, valueT>&& key_value_pair)
+{
+	return try_emplace(std::move(key_value_pair.first), std::move(key_value_pair.second));
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename... arguments>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::emplace(arguments&&... pair_arguments)
+{
+	node* new_node = create_node(nullptr, std::forward<arguments>(pair_arguments)...);
+	node* parent;
+	node* existing = locate(new_node->key_value_pair.first, parent);
+
+	if (existing)
 	{
-		root = new node(key_value_pair);
-		++m_size;
+		destroy_node(new_node);
+		return std::make_pair(iterator(existing, this), false);
 	}
-	else
+
+	attach(new_node, parent);
+	return std::make_pair(iterator(new_node, this), true);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename... arguments>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::try_emplace(const keyT& key, arguments&&... value_arguments)
+{
+	node* parent;
+	node* existing = locate(key, parent);
+
+	if (existing)
 	{
-		node* current_node = root;
-		node* prev = nullptr;
+		return std::make_pair(iterator(existing, this), false);
+	}
 
-		while (current_node != nullptr)
-		{
-			prev = current_node;
+	node* new_node = create_node(parent, std::piecewise_construct, std::forward_as_tuple(key), std::forward_as_tuple(std::forward<arguments>(value_arguments)...));
+	attach(new_node, parent);
+	return std::make_pair(iterator(new_node, this), true);
+}
 
-			if (cmp()(key_value_pair.first, current_node->key_value_pair.first))
-			{
-				current_node = current_node->left;
-			}
-			else if (key_value_pair.first == current_node->key_value_pair.first)
-			{
-				return;
-			}
-			else
-			{
-				current_node = current_node->right;
-			}
-		}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename... arguments>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::try_emplace(keyT&& key, arguments&&... value_arguments)
+{
+	node* parent;
+	node* existing = locate(key, parent);
 
-		if (cmp()(key_value_pair.first, prev->key_value_pair.first))
-		{
-			prev->left = new node(key_value_pair, prev);
-			current_node = prev->left;
-		}
-		else
-		{
-			prev->right = new node(key_value_pair, prev);
-			current_node = prev->right;
-		}
+	if (existing)
+	{
+		return std::make_pair(iterator(existing, this), false);
+	}
+
+	node* new_node = create_node(parent, std::piecewise_construct, std::forward_as_tuple(std::move(key)), std::forward_as_tuple(std::forward<arguments>(value_arguments)...));
+	attach(new_node, parent);
+	return std::make_pair(iterator(new_node, this), true);
+}
 
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename mappedT>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::insert_or_assign(const keyT& key, mappedT&& value)
+{
+	std::pair<iterator, bool> result = try_emplace(key, std::forward<mappedT>(value));
+	if (!result.second)
+	{
+		result.first->second = std::forward<mappedT>(value);
+	}
+	return result;
+}
 
-		rebalance_insert(current_node);
-		++m_size;
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename mappedT>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::insert_or_assign(keyT&& key, mappedT&& value)
+{
+	std::pair<iterator, bool> result = try_emplace(std::move(key), std::forward<mappedT>(value));
+	if (!result.second)
+	{
+		result.first->second = std::forward<mappedT>(value);
 	}
+	return result;
 }
 
-template<typename keyT, typename valueT, typename cmp>
-valueT& map<keyT, valueT, cmp>::operator[](keyT key)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline valueT& map<keyT, valueT, cmp, allocator>::operator[](const keyT& key)
 {
-	if (root == nullptr)
+	return try_emplace(key).first->second;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline valueT& map<keyT, valueT, cmp, allocator>::operator[](keyT&& key)
+{
+	return try_emplace(std::move(key)).first->second;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node_handle map<keyT, valueT, cmp, allocator>::extract(iterator it)
+{
+	if (!it.m_node)
 	{
-		root = new node(std::make_pair(key, valueT()));
-		++m_size;
-		return root->key_value_pair.second;
+		return node_handle();
+	}
+
+	unlink(it.m_node);
+	return node_handle(it.m_node, alloc);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline typename map<keyT, valueT, cmp, allocator>::node_handle map<keyT, valueT, cmp, allocator>::extract(const keyT& key)
+{
+	return extract(find(key));
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, bool> map<keyT, valueT, cmp, allocator>::insert(node_handle&& handle)
+{
+	if (!handle.m_node)
+	{
+		return std::make_pair(end(), false);
+	}
+
+	node* parent;
+	node* existing = locate(handle.m_node->key_value_pair.first, parent);
+
+	if (existing)
+	{
+		return std::make_pair(iterator(existing, this), false);
+	}
+
+	node* new_node = handle.m_node;
+	if (*handle.alloc == alloc)
+	{
+		handle.m_node = nullptr;
+		handle.alloc.reset();
 	}
 	else
 	{
-		node* current_node = root;
-		node* prev = nullptr;
+		// a node from another pool cannot be freed by ours, so only its pair moves over
+		new_node = create_node(parent, std::move(new_node->key_value_pair));
+		handle.reset();
+	}
 
-		while (current_node != nullptr)
-		{
-			prev = current_node;
+	attach(new_node, parent);
+	return std::make_pair(iterator(new_node, this), true);
+}
 
-			if (cmp()(key, current_node->key_value_pair.first))
-			{
-				current_node = current_node->left;
-			}
-			else if (key == current_node->key_value_pair.first)
-			{
-				return current_node->key_value_pair.second;
-			}
-			else
-			{
-				current_node = current_node->right;
-			}
-		}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::locate(const keyT& key, node*& parent)
+{
+	node* current_node = root;
+	parent = nullptr;
 
-		if (cmp()(key, prev->key_value_pair.first))
+	while (current_node)
+	{
+		if (cmp()(key, current_node->key_value_pair.first))
 		{
-			prev->left = new node(std::make_pair(key, valueT()), prev);
-			current_node = prev->left;
+			parent = current_node;
+			current_node = current_node->left;
+		}
+		else if (cmp()(current_node->key_value_pair.first, key))
+		{
+			parent = current_node;
+			current_node = current_node->right;
 		}
 		else
 		{
-			prev->right = new node(std::make_pair(key, valueT()), prev);
-			current_node = prev->right;
+			return current_node;
 		}
+	}
+
+	return nullptr;
+}
 
-		rebalance_insert(current_node);
-		++m_size;
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::attach(node* new_node, node* parent)
+{
+	new_node->parent = parent;
+	new_node->left = new_node->right = nullptr;
+	new_node->height = 0;
+	new_node->size = 1;
+	++m_size;
 
-		return current_node->key_value_pair.second;
+	if (!parent)
+	{
+		root = new_node;
+		return;
+	}
+
+	if (cmp()(new_node->key_value_pair.first, parent->key_value_pair.first))
+	{
+		parent->left = new_node;
+	}
+	else
+	{
+		parent->right = new_node;
 	}
+
+	update_sizes(parent);
+	rebalance_insert(new_node);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::erase(node* this_node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::erase(node* this_node)
 {
 	if (this_node == nullptr) return;
 
+	unlink(this_node);
+	destroy_node(this_node);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::unlink(node* this_node)
+{
+
 	node*& son = (this_node == root) ? root :
 		(this_node->parent->right == this_node ? this_node->parent->right : this_node->parent->left);
 	node* rebalance_from = this_node->parent;
@@ -280,6 +604,8 @@ void map<keyT, valueT, cmp>::erase(node* this_node)
 
 		if (succ != this_node->right)
 		{
+			// the subtree that actually shrank is the one succ was taken out of
+			rebalance_from = succ->parent;
 			succ->parent->left = succ->right;
 			if (succ->right)
 				succ->right->parent = succ->parent;
@@ -292,11 +618,14 @@ void map<keyT, valueT, cmp>::erase(node* this_node)
 		this_node->left->parent = succ;
 
 		succ->parent = this_node->parent;
+		// succ takes over the place, and until the rebalancing below reaches
+		// it, the height that goes with it
+		succ->height = this_node->height;
 		son = succ;
 	}
 
-	delete this_node;
 	--m_size;
+	update_sizes(rebalance_from);
 
 	this_node = rebalance_from;
 	while (this_node != nullptr)
@@ -345,32 +674,33 @@ void map<keyT, valueT, cmp>::erase(node* this_node)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::erase(keyT key)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::erase(const keyT& key)
 {
 	erase(find(key).m_node);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-inline void map<keyT, valueT, cmp>::erase(iterator it)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline void map<keyT, valueT, cmp, allocator>::erase(iterator it)
 {
 	erase(it.m_node);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::clear()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::clear()
 {
-	this->~map();
-	m_size = 0;
+	release();
 }
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::init(const map& other)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::init(const map& other)
 {
 	m_size = other.m_size;
 	if (other.root)
 	{
-		root = new node({ other.root->key,other.root->value });
+		root = create_node(nullptr, other.root->key_value_pair);
+		root->height = other.root->height;
+		root->size = other.root->size;
 
 		std::stack < std::pair<node*, node*>> stack;
 		stack.push({ root,other.root });
@@ -382,12 +712,16 @@ void map<keyT, valueT, cmp>::init(const map& other)
 
 			if (pair.second->right)
 			{
-				pair.first->right = new node({ pair.second->right->key,pair.second->right->value }, pair.first);
+				pair.first->right = create_node(pair.first, pair.second->right->key_value_pair);
+				pair.first->right->height = pair.second->right->height;
+				pair.first->right->size = pair.second->right->size;
 				stack.push({ pair.first->right ,pair.second->right });
 			}
 			if (pair.second->left)
 			{
-				pair.first->left = new node({ pair.second->left->key ,pair.second->left->value }, pair.first);
+				pair.first->left = create_node(pair.first, pair.second->left->key_value_pair);
+				pair.first->left->height = pair.second->left->height;
+				pair.first->left->size = pair.second->left->size;
 				stack.push({ pair.first->left,pair.second->left });
 			}
 
@@ -396,19 +730,215 @@ void map<keyT, valueT, cmp>::init(const map& other)
 	else root = nullptr;
 }
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::find(keyT key)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::release()
+{
+	if (root && !release_nodes<node>(alloc))
+	{
+		std::queue<node*> q;
+		q.push(root);
+
+		while (!q.empty())
+		{
+			if (q.front()->right)
+			{
+				q.push(q.front()->right);
+			}
+			if (q.front()->left)
+			{
+				q.push(q.front()->left);
+			}
+			destroy_node(q.front());
+			q.pop();
+		}
+	}
+	root = nullptr;
+	m_size = 0;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::build(std::vector<std::pair<keyT, valueT>>& pairs)
+{
+	auto key_less = [](const std::pair<keyT, valueT>& a, const std::pair<keyT, valueT>& b) { return cmp()(a.first, b.first); };
+
+	// a sorted range with unique keys is used as is; otherwise it is sorted
+	// once, stably, and like insert() the first pair of every key wins
+	if (std::adjacent_find(pairs.begin(), pairs.end(), [&](const std::pair<keyT, valueT>& a, const std::pair<keyT, valueT>& b) { return !key_less(a, b); }) != pairs.end())
+	{
+		parallel_sort(pairs.begin(), pairs.end(), key_less);
+		pairs.erase(std::unique(pairs.begin(), pairs.end(), [&](const std::pair<keyT, valueT>& a, const std::pair<keyT, valueT>& b) { return !key_less(a, b); }), pairs.end());
+	}
+
+	struct range
+	{
+		size_t first, last;
+		node* parent;
+		node** link;
+	};
+
+	std::stack<range> stack;
+	stack.push({ 0, pairs.size(), nullptr, &root });
+
+	while (!stack.empty())
+	{
+		range current = stack.top();
+		stack.pop();
+
+		if (current.first == current.last) continue;
+
+		size_t middle = current.first + (current.last - current.first) / 2;
+		node* new_node = create_node(current.parent, std::move(pairs[middle]));
+		new_node->height = balanced_height(current.last - current.first);
+		new_node->size = current.last - current.first;
+		*current.link = new_node;
+
+		stack.push({ middle + 1, current.last, new_node, &new_node->right });
+		stack.push({ current.first, middle, new_node, &new_node->left });
+	}
+	m_size = pairs.size();
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+int map<keyT, valueT, cmp, allocator>::balanced_height(size_t size)
+{
+	int height = -1;
+	while (size)
+	{
+		size >>= 1;
+		++height;
+	}
+	return height;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename... arguments>
+inline typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::create_node(node* parent, arguments&&... pair_arguments)
+{
+	node* new_node = std::allocator_traits<node_allocator>::allocate(alloc, 1);
+	std::allocator_traits<node_allocator>::construct(alloc, new_node, parent, std::forward<arguments>(pair_arguments)...);
+	return new_node;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline void map<keyT, valueT, cmp, allocator>::destroy_node(node* this_node)
+{
+	std::allocator_traits<node_allocator>::destroy(alloc, this_node);
+	std::allocator_traits<node_allocator>::deallocate(alloc, this_node, 1);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::find(const keyT& key)
+{
+	node* parent;
+	return iterator(locate(key, parent), this);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::lower_bound(const keyT& key)
+{
+	return iterator(bound(key, false), this);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::upper_bound(const keyT& key)
+{
+	return iterator(bound(key, true), this);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+std::pair<typename map<keyT, valueT, cmp, allocator>::iterator, typename map<keyT, valueT, cmp, allocator>::iterator> map<keyT, valueT, cmp, allocator>::equal_range(const keyT& key)
+{
+	iterator first = lower_bound(key);
+	if (first.m_node && !cmp()(key, first.m_node->key_value_pair.first))
+	{
+		return std::make_pair(first, iterator(succ(first.m_node), this));
+	}
+	return std::make_pair(first, first);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename visitor>
+inline void map<keyT, valueT, cmp, allocator>::for_each_in_range(const keyT& low, const keyT& high, visitor&& visit)
+{
+	if (!cmp()(high, low))
+	{
+		visit_range(root, low, high, visit);
+	}
+}
+
+// smallest key greater than key (inclusive) or not less than it, nullptr if none
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::bound(const keyT& key, bool inclusive)
 {
+	node* result = nullptr;
 	node* current_node = root;
 
-	while (current_node && current_node->key_value_pair.first != key)
+	while (current_node)
 	{
-		if (cmp()(key, current_node->key_value_pair.first))
+		if (inclusive ? cmp()(key, current_node->key_value_pair.first) : !cmp()(current_node->key_value_pair.first, key))
+		{
+			result = current_node;
+			current_node = current_node->left;
+		}
+		else
+		{
+			current_node = current_node->right;
+		}
+	}
+
+	return result;
+}
+
+// Subtrees entirely outside [low, high] are never entered.
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+template<typename visitor>
+void map<keyT, valueT, cmp, allocator>::visit_range(node* subtree, const keyT& low, const keyT& high, visitor& visit)
+{
+	while (subtree)
+	{
+		if (cmp()(subtree->key_value_pair.first, low))
+		{
+			subtree = subtree->right;
+		}
+		else if (cmp()(high, subtree->key_value_pair.first))
+		{
+			subtree = subtree->left;
+		}
+		else
+		{
+			visit_range(subtree->left, low, high, visit);
+			visit(subtree->key_value_pair);
+			subtree = subtree->right;
+		}
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+size_t map<keyT, valueT, cmp, allocator>::rank(const keyT& key)
+{
+	return count_below(key, false);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::select(size_t k)
+{
+	node* current_node = root;
+
+	while (current_node)
+	{
+		size_t left_size = current_node->left ? current_node->left->size : 0;
+
+		if (k < left_size)
 		{
 			current_node = current_node->left;
 		}
+		else if (k == left_size)
+		{
+			break;
+		}
 		else
 		{
+			k -= left_size + 1;
 			current_node = current_node->right;
 		}
 	}
@@ -416,8 +946,417 @@ typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::find(keyT key)
 	return iterator(current_node, this);
 }
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::max(node* root)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+size_t map<keyT, valueT, cmp, allocator>::count_range(const keyT& low, const keyT& high)
+{
+	if (cmp()(high, low))
+	{
+		return 0;
+	}
+	return count_below(high, true) - count_below(low, false);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+size_t map<keyT, valueT, cmp, allocator>::count_below(const keyT& key, bool inclusive)
+{
+	size_t count = 0;
+	node* current_node = root;
+
+	while (current_node)
+	{
+		if (inclusive ? !cmp()(key, current_node->key_value_pair.first) : cmp()(current_node->key_value_pair.first, key))
+		{
+			count += (current_node->left ? current_node->left->size : 0) + 1;
+			current_node = current_node->right;
+		}
+		else
+		{
+			current_node = current_node->left;
+		}
+	}
+	return count;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::split(const keyT& key, map& greater)
+{
+	greater.release();
+	greater.alloc = alloc;
+
+	node* left;
+	node* right;
+	split_nodes(root, key, false, left, right);
+	set_root(left);
+	greater.set_root(right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::join(const std::pair<keyT, valueT>& key_value_pair, map& right)
+{
+	adopt(right);
+	set_root(join_nodes(root, create_node(nullptr, key_value_pair), right.root));
+	right.root = nullptr;
+	right.m_size = 0;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::join(map& right)
+{
+	adopt(right);
+	set_root(join_nodes(root, right.root));
+	right.root = nullptr;
+	right.m_size = 0;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::union_with(map& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(union_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	other.m_size = 0;
+	destroy_nodes(dropped);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::intersect_with(map& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(intersect_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	other.m_size = 0;
+	destroy_nodes(dropped);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::difference_with(map& other)
+{
+	adopt(other);
+	std::vector<node*> dropped;
+	set_root(difference_nodes(root, other.root, dropped, fork_depth()));
+	other.root = nullptr;
+	other.m_size = 0;
+	destroy_nodes(dropped);
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline int map<keyT, valueT, cmp, allocator>::subtree_height(node* subtree)
+{
+	return subtree ? subtree->height : -1;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline size_t map<keyT, valueT, cmp, allocator>::subtree_size(node* subtree)
+{
+	return subtree ? subtree->size : 0;
+}
+
+// The helpers below work on detached subtrees: a returned root may still
+// point at a stale parent, which whoever links it in (or set_root) fixes.
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::make_node(node* left, node* middle, node* right)
+{
+	middle->left = left;
+	middle->right = right;
+	if (left) left->parent = middle;
+	if (right) right->parent = middle;
+	middle->recalculate_height();
+	middle->recalculate_size();
+	return middle;
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::rotate_left_subtree(node* subtree)
+{
+	node* top = subtree->right;
+	make_node(subtree->left, subtree, top->left);
+	return make_node(subtree, top, top->right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::rotate_right_subtree(node* subtree)
+{
+	node* top = subtree->left;
+	make_node(top->right, subtree, subtree->right);
+	return make_node(top->left, top, subtree);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::join_right(node* left, node* middle, node* right)
+{
+	node* spine = left->right;
+
+	if (subtree_height(spine) <= subtree_height(right) + 1)
+	{
+		node* joined = make_node(spine, middle, right);
+		if (subtree_height(joined) <= subtree_height(left->left) + 1)
+		{
+			return make_node(left->left, left, joined);
+		}
+		return rotate_left_subtree(make_node(left->left, left, rotate_right_subtree(joined)));
+	}
+
+	node* joined = join_right(spine, middle, right);
+	node* result = make_node(left->left, left, joined);
+	if (subtree_height(joined) <= subtree_height(left->left) + 1)
+	{
+		return result;
+	}
+	return rotate_left_subtree(result);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::join_left(node* left, node* middle, node* right)
+{
+	node* spine = right->left;
+
+	if (subtree_height(spine) <= subtree_height(left) + 1)
+	{
+		node* joined = make_node(left, middle, spine);
+		if (subtree_height(joined) <= subtree_height(right->right) + 1)
+		{
+			return make_node(joined, right, right->right);
+		}
+		return rotate_right_subtree(make_node(rotate_left_subtree(joined), right, right->right));
+	}
+
+	node* joined = join_left(left, middle, spine);
+	node* result = make_node(joined, right, right->right);
+	if (subtree_height(joined) <= subtree_height(right->right) + 1)
+	{
+		return result;
+	}
+	return rotate_right_subtree(result);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::join_nodes(node* left, node* middle, node* right)
+{
+	if (subtree_height(left) > subtree_height(right) + 1)
+	{
+		return join_right(left, middle, right);
+	}
+	if (subtree_height(right) > subtree_height(left) + 1)
+	{
+		return join_left(left, middle, right);
+	}
+	return make_node(left, middle, right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::join_nodes(node* left, node* right)
+{
+	if (!right)
+	{
+		return left;
+	}
+
+	node* first;
+	node* rest;
+	split_first(right, first, rest);
+	return join_nodes(left, first, rest);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::split_nodes(node* tree, const keyT& key, bool inclusive, node*& left, node*& right)
+{
+	if (!tree)
+	{
+		left = right = nullptr;
+		return;
+	}
+
+	node* tree_left = tree->left;
+	node* tree_right = tree->right;
+
+	if (inclusive ? !cmp()(key, tree->key_value_pair.first) : cmp()(tree->key_value_pair.first, key))
+	{
+		node* lower;
+		split_nodes(tree_right, key, inclusive, lower, right);
+		left = join_nodes(tree_left, tree, lower);
+	}
+	else
+	{
+		node* upper;
+		split_nodes(tree_left, key, inclusive, left, upper);
+		right = join_nodes(upper, tree, tree_right);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::split_first(node* tree, node*& first, node*& rest)
+{
+	if (!tree->left)
+	{
+		first = tree;
+		rest = tree->right;
+		return;
+	}
+
+	node* tree_right = tree->right;
+	node* left_rest;
+	split_first(tree->left, first, left_rest);
+	rest = join_nodes(left_rest, tree, tree_right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::collect(node* subtree, std::vector<node*>& nodes)
+{
+	std::stack<node*> stack;
+	if (subtree) stack.push(subtree);
+
+	while (!stack.empty())
+	{
+		node* current_node = stack.top();
+		stack.pop();
+		nodes.push_back(current_node);
+
+		if (current_node->left) stack.push(current_node->left);
+		if (current_node->right) stack.push(current_node->right);
+	}
+}
+
+// Dropped nodes are freed by the caller afterwards, on its own thread.
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::union_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first) return second;
+	if (!second) return first;
+
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(second, first->key_value_pair.first, false, lower, rest);
+	split_nodes(rest, first->key_value_pair.first, true, equal, upper);
+	collect(equal, dropped);
+
+	node* first_left = first->left;
+	node* first_right = first->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = union_nodes(first_left, lower, forked_dropped, depth - 1); },
+		[&] { right = union_nodes(first_right, upper, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	return join_nodes(left, first, right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::intersect_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first || !second)
+	{
+		collect(first, dropped);
+		collect(second, dropped);
+		return nullptr;
+	}
+
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(second, first->key_value_pair.first, false, lower, rest);
+	split_nodes(rest, first->key_value_pair.first, true, equal, upper);
+	bool found = equal != nullptr;
+	collect(equal, dropped);
+
+	node* first_left = first->left;
+	node* first_right = first->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = intersect_nodes(first_left, lower, forked_dropped, depth - 1); },
+		[&] { right = intersect_nodes(first_right, upper, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	if (found)
+	{
+		return join_nodes(left, first, right);
+	}
+	dropped.push_back(first);
+	return join_nodes(left, right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::difference_nodes(node* first, node* second, std::vector<node*>& dropped, int depth)
+{
+	if (!first || !second)
+	{
+		collect(second, dropped);
+		return first;
+	}
+
+	node* lower;
+	node* rest;
+	node* equal;
+	node* upper;
+	split_nodes(first, second->key_value_pair.first, false, lower, rest);
+	split_nodes(rest, second->key_value_pair.first, true, equal, upper);
+	collect(equal, dropped);
+
+	node* second_left = second->left;
+	node* second_right = second->right;
+	node* left;
+	node* right;
+	std::vector<node*> forked_dropped;
+
+	fork_join(depth > 0 && subtree_size(first) + subtree_size(second) >= parallel_grain,
+		[&] { left = difference_nodes(lower, second_left, forked_dropped, depth - 1); },
+		[&] { right = difference_nodes(upper, second_right, dropped, depth - 1); });
+
+	dropped.insert(dropped.end(), forked_dropped.begin(), forked_dropped.end());
+	dropped.push_back(second);
+	return join_nodes(left, right);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline void map<keyT, valueT, cmp, allocator>::set_root(node* new_root)
+{
+	root = new_root;
+	if (root) root->parent = nullptr;
+	m_size = subtree_size(root);
+}
+
+// Nodes may only be relinked between maps whose allocators can free each
+// other's nodes; otherwise other is rebuilt with this map's allocator first.
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::adopt(map& other)
+{
+	if (other.alloc == alloc)
+	{
+		return;
+	}
+
+	std::vector<std::pair<keyT, valueT>> pairs;
+	for (node* current_node = min(other.root); current_node; current_node = succ(current_node))
+	{
+		pairs.push_back(current_node->key_value_pair);
+	}
+	other.release();
+	other.alloc = alloc;
+	other.build(pairs);
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::destroy_nodes(std::vector<node*>& nodes)
+{
+	for (node* current_node : nodes)
+	{
+		destroy_node(current_node);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::max(node* root)
 {
 	if (!root)
 	{
@@ -433,8 +1372,8 @@ typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::max(node* root)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::min(node* root)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::min(node* root)
 {
 	if (!root)
 	{
@@ -450,8 +1389,18 @@ typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::min(node* root)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline void map<keyT, valueT, cmp>::rebalance_insert(node* current_node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline void map<keyT, valueT, cmp, allocator>::update_sizes(node* from)
+{
+	for (; from != nullptr; from = from->parent)
+	{
+		from->recalculate_size();
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline void map<keyT, valueT, cmp, allocator>::rebalance_insert(node* current_node)
 {
 	while (current_node != root)
 	{
@@ -492,8 +1441,8 @@ inline void map<keyT, valueT, cmp>::rebalance_insert(node* current_node)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::rotate_left(node* this_node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::rotate_left(node* this_node)
 {
 
 	if (this_node->right)
@@ -526,12 +1475,14 @@ void map<keyT, valueT, cmp>::rotate_left(node* this_node)
 
 		this_node->recalculate_height();
 		this_node->parent->recalculate_height();
+		this_node->recalculate_size();
+		this_node->parent->recalculate_size();
 	}
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::rotate_right(node* this_node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::rotate_right(node* this_node)
 {
 
 	if (this_node->left)
@@ -564,26 +1515,28 @@ void map<keyT, valueT, cmp>::rotate_right(node* this_node)
 
 		this_node->recalculate_height();
 		this_node->parent->recalculate_height();
+		this_node->recalculate_size();
+		this_node->parent->recalculate_size();
 	}
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline size_t map<keyT, valueT, cmp>::size()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline size_t map<keyT, valueT, cmp, allocator>::size()
 {
 	return m_size;
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline bool map<keyT, valueT, cmp>::empty()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline bool map<keyT, valueT, cmp, allocator>::empty()
 {
 	return m_size == 0;
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::succ(node* node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::succ(node* node)
 {
 	if (!node)
 	{
@@ -604,8 +1557,8 @@ typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::succ(node* node)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::pred(node* node)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node* map<keyT, valueT, cmp, allocator>::pred(node* node)
 {
 	if (!node)
 	{
@@ -625,8 +1578,8 @@ typename map<keyT, valueT, cmp>::node* map<keyT, valueT, cmp>::pred(node* node)
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-int map<keyT, valueT, cmp>::node::balance_factor()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+int map<keyT, valueT, cmp, allocator>::node::balance_factor()
 {
 	int right_h = right == nullptr ? -1 : right->height;
 	int left_h = left == nullptr ? -1 : left->height;
@@ -634,8 +1587,8 @@ int map<keyT, valueT, cmp>::node::balance_factor()
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-void map<keyT, valueT, cmp>::node::recalculate_height()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::node::recalculate_height()
 {
 	if (!this->left && !this->right) this->height = 0;
 	else if (!this->left)  this->height = this->right->height + 1;
@@ -644,38 +1597,45 @@ void map<keyT, valueT, cmp>::node::recalculate_height()
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline map<keyT, valueT, cmp>::iterator::iterator() :m_node(nullptr), m_map(nullptr) {}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::node::recalculate_size()
+{
+	this->size = (this->left ? this->left->size : 0) + (this->right ? this->right->size : 0) + 1;
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline map<keyT, valueT, cmp, allocator>::iterator::iterator() :m_node(nullptr), m_map(nullptr) {}
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline map<keyT, valueT, cmp>::iterator::iterator(node* some_node, map* some_map) : m_node(some_node), m_map(some_map) {}
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline map<keyT, valueT, cmp, allocator>::iterator::iterator(node* some_node, map* some_map) : m_node(some_node), m_map(some_map) {}
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::iterator::reference map<keyT, valueT, cmp>::iterator::operator*() const
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator::reference map<keyT, valueT, cmp, allocator>::iterator::operator*() const
 {
 	return m_node->key_value_pair;
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::iterator::pointer map<keyT, valueT, cmp>::iterator::operator->()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator::pointer map<keyT, valueT, cmp, allocator>::iterator::operator->()
 {
 	return &(m_node->key_value_pair);
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::iterator& map<keyT, valueT, cmp>::iterator::operator++()
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator& map<keyT, valueT, cmp, allocator>::iterator::operator++()
 {
 	m_node = m_map->succ(m_node);
 	return *this;
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::iterator::operator++(int)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::iterator::operator++(int)
 {
 	iterator tmp = *this;
 	++(*this);
@@ -683,16 +1643,76 @@ typename map<keyT, valueT, cmp>::iterator map<keyT, valueT, cmp>::iterator::oper
 }
 
 
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator& map<keyT, valueT, cmp, allocator>::iterator::operator--()
+{
+	m_node = m_node ? m_map->pred(m_node) : m_map->max(m_map->root);
+	return *this;
+}
+
 
-template<typename keyT, typename valueT, typename cmp>
-inline bool  map<keyT, valueT, cmp>::iterator::operator==(const iterator& other)
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::iterator map<keyT, valueT, cmp, allocator>::iterator::operator--(int)
 {
-	return this->m_node == other->m_node;
+	iterator tmp = *this;
+	--(*this);
+	return tmp;
 }
 
 
-template<typename keyT, typename valueT, typename cmp>
-inline bool  map<keyT, valueT, cmp>::iterator::operator!=(const iterator& other)
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline bool  map<keyT, valueT, cmp, allocator>::iterator::operator==(const iterator& other) const
+{
+	return this->m_node == other.m_node;
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline bool  map<keyT, valueT, cmp, allocator>::iterator::operator!=(const iterator& other) const
 {
 	return this->m_node != other.m_node;
-}
\ No newline at end of file
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline map<keyT, valueT, cmp, allocator>::node_handle::node_handle(node_handle&& other) : m_node(other.m_node), alloc(std::move(other.alloc))
+{
+	other.m_node = nullptr;
+	other.alloc.reset();
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+typename map<keyT, valueT, cmp, allocator>::node_handle& map<keyT, valueT, cmp, allocator>::node_handle::operator=(node_handle&& other)
+{
+	if (this != &other)
+	{
+		reset();
+		m_node = other.m_node;
+		alloc = std::move(other.alloc);
+		other.m_node = nullptr;
+		other.alloc.reset();
+	}
+	return *this;
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+inline map<keyT, valueT, cmp, allocator>::node_handle::~node_handle()
+{
+	reset();
+}
+
+
+template<typename keyT, typename valueT, typename cmp, typename allocator>
+void map<keyT, valueT, cmp, allocator>::node_handle::reset()
+{
+	if (m_node)
+	{
+		std::allocator_traits<node_allocator>::destroy(*alloc, m_node);
+		std::allocator_traits<node_allocator>::deallocate(*alloc, m_node, 1);
+		m_node = nullptr;
+		alloc.reset();
+	}
+}
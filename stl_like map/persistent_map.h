@@ -0,0 +1,461 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+// Persistent ordered map: an AVL tree whose nodes are never changed once
+// built. An update copies only the nodes on the path from the root to the
+// key, O(log n) of them, and shares every other subtree with the version it
+// started from; nodes are owned through shared_ptr and go away with the last
+// version that still reaches them.
+//
+// snapshot() and copying are O(1) and give a frozen version that any number
+// of threads may read, iterate and copy without locking. A map may be updated
+// by one thread at a time, and other threads may take snapshots of it while
+// that goes on. Updating a snapshot branches off a version of its own.
+template<typename keyT, typename valueT, typename cmp = std::less<keyT>>
+class persistent_map
+{
+private:
+	struct node;
+	using node_ptr = std::shared_ptr<const node>;
+
+	struct node
+	{
+		std::pair<const keyT, valueT> key_value_pair;
+		node_ptr left, right;
+		int height;
+		size_t size;	// nodes in this subtree
+
+		node(const node_ptr& left, const std::pair<keyT, valueT>& key_value_pair, const node_ptr& right);
+	};
+
+public:
+	// Walks the version it was created from, which it keeps alive.
+	class iterator
+	{
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::pair<const keyT, valueT>;
+		using pointer = const value_type*;
+		using reference = const value_type&;
+	private:
+		node_ptr m_root;
+		std::vector<const node*> m_path;	// nodes still to visit on the way up, next one on top
+	public:
+		iterator();
+		reference operator*() const;
+		pointer operator->() const;
+		iterator& operator++();
+		iterator operator++(int);
+		bool operator==(const iterator& other) const;
+		bool operator!=(const iterator& other) const;
+
+		friend class persistent_map;
+	};
+
+private:
+	node_ptr root;
+
+	node_ptr load_root() const;
+	void store_root(node_ptr new_root);
+
+	static int height(const node_ptr& subtree);
+	static size_t subtree_size(const node_ptr& subtree);
+	static node_ptr balance(const node_ptr& left, const std::pair<keyT, valueT>& key_value_pair, const node_ptr& right);
+	static node_ptr insert(const node_ptr& subtree, const std::pair<keyT, valueT>& key_value_pair, bool assign, bool& changed);
+	static node_ptr erase(const node_ptr& subtree, const keyT& key, bool& erased);
+	static node_ptr erase_min(const node_ptr& subtree, const node*& min);
+	template<typename visitor>
+	static void visit_range(const node* subtree, const keyT& low, const keyT& high, visitor& visit);
+
+public:
+	persistent_map();
+	persistent_map(const persistent_map& other);
+	persistent_map& operator=(const persistent_map& other);
+
+	// the current version, in O(1)
+	persistent_map snapshot() const;
+
+	// false if the key was already there
+	bool insert(const std::pair<keyT, valueT>& key_value_pair);
+	void insert_or_assign(const std::pair<keyT, valueT>& key_value_pair);
+	bool erase(const keyT& key);
+
+	iterator begin() const;
+	iterator end() const;
+	iterator find(const keyT& key) const;
+	// first key not less than key, end() if none
+	iterator lower_bound(const keyT& key) const;
+	// calls visit(pair) for every key in [low, high] in order
+	template<typename visitor>
+	void for_each_in_range(const keyT& low, const keyT& high, visitor&& visit) const;
+
+	size_t size() const;
+	bool empty() const;
+};
+
+
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp>::node::node(const node_ptr& left, const std::pair<keyT, valueT>& key_value_pair, const node_ptr& right) :
+	key_value_pair(key_value_pair), left(left), right(right),
+	height(std::max(persistent_map::height(left), persistent_map::height(right)) + 1),
+	size(subtree_size(left) + subtree_size(right) + 1) {}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp>::persistent_map() {}
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp>::persistent_map(const persistent_map& other) : root(other.load_root()) {}
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp>& persistent_map<keyT, valueT, cmp>::operator=(const persistent_map& other)
+{
+	store_root(other.load_root());
+	return *this;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp> persistent_map<keyT, valueT, cmp>::snapshot() const
+{
+	return *this;
+}
+
+
+// The root is the only thing a snapshot and an update race on.
+template<typename keyT, typename valueT, typename cmp>
+inline typename persistent_map<keyT, valueT, cmp>::node_ptr persistent_map<keyT, valueT, cmp>::load_root() const
+{
+	return std::atomic_load(&root);
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline void persistent_map<keyT, valueT, cmp>::store_root(node_ptr new_root)
+{
+	std::atomic_store(&root, std::move(new_root));
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+bool persistent_map<keyT, valueT, cmp>::insert(const std::pair<keyT, valueT>& key_value_pair)
+{
+	bool changed = false;
+	node_ptr new_root = insert(root, key_value_pair, false, changed);
+	if (changed)
+	{
+		store_root(std::move(new_root));
+	}
+	return changed;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+void persistent_map<keyT, valueT, cmp>::insert_or_assign(const std::pair<keyT, valueT>& key_value_pair)
+{
+	bool changed = false;
+	store_root(insert(root, key_value_pair, true, changed));
+}
+
+template<typename keyT, typename valueT, typename cmp>
+bool persistent_map<keyT, valueT, cmp>::erase(const keyT& key)
+{
+	bool erased = false;
+	node_ptr new_root = erase(root, key, erased);
+	if (erased)
+	{
+		store_root(std::move(new_root));
+	}
+	return erased;
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline int persistent_map<keyT, valueT, cmp>::height(const node_ptr& subtree)
+{
+	return subtree ? subtree->height : -1;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline size_t persistent_map<keyT, valueT, cmp>::subtree_size(const node_ptr& subtree)
+{
+	return subtree ? subtree->size : 0;
+}
+
+// New node over left and right, which differ in height by at most two,
+// rotated back into AVL shape where they differ by two.
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::node_ptr persistent_map<keyT, valueT, cmp>::balance(const node_ptr& left, const std::pair<keyT, valueT>& key_value_pair, const node_ptr& right)
+{
+	if (height(left) > height(right) + 1)
+	{
+		if (height(left->left) >= height(left->right))
+		{
+			return std::make_shared<const node>(left->left, left->key_value_pair,
+				std::make_shared<const node>(left->right, key_value_pair, right));
+		}
+		return std::make_shared<const node>(
+			std::make_shared<const node>(left->left, left->key_value_pair, left->right->left),
+			left->right->key_value_pair,
+			std::make_shared<const node>(left->right->right, key_value_pair, right));
+	}
+
+	if (height(right) > height(left) + 1)
+	{
+		if (height(right->right) >= height(right->left))
+		{
+			return std::make_shared<const node>(std::make_shared<const node>(left, key_value_pair, right->left),
+				right->key_value_pair, right->right);
+		}
+		return std::make_shared<const node>(
+			std::make_shared<const node>(left, key_value_pair, right->left->left),
+			right->left->key_value_pair,
+			std::make_shared<const node>(right->left->right, right->key_value_pair, right->right));
+	}
+
+	return std::make_shared<const node>(left, key_value_pair, right);
+}
+
+// Returns subtree itself, with nothing copied, when the key was already there
+// and assign is not set.
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::node_ptr persistent_map<keyT, valueT, cmp>::insert(const node_ptr& subtree, const std::pair<keyT, valueT>& key_value_pair, bool assign, bool& changed)
+{
+	if (!subtree)
+	{
+		changed = true;
+		return std::make_shared<const node>(nullptr, key_value_pair, nullptr);
+	}
+
+	if (cmp()(key_value_pair.first, subtree->key_value_pair.first))
+	{
+		node_ptr left = insert(subtree->left, key_value_pair, assign, changed);
+		return left == subtree->left ? subtree : balance(left, subtree->key_value_pair, subtree->right);
+	}
+	if (cmp()(subtree->key_value_pair.first, key_value_pair.first))
+	{
+		node_ptr right = insert(subtree->right, key_value_pair, assign, changed);
+		return right == subtree->right ? subtree : balance(subtree->left, subtree->key_value_pair, right);
+	}
+
+	if (!assign)
+	{
+		return subtree;
+	}
+	changed = true;
+	return std::make_shared<const node>(subtree->left, key_value_pair, subtree->right);
+}
+
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::node_ptr persistent_map<keyT, valueT, cmp>::erase(const node_ptr& subtree, const keyT& key, bool& erased)
+{
+	if (!subtree)
+	{
+		return nullptr;
+	}
+
+	if (cmp()(key, subtree->key_value_pair.first))
+	{
+		node_ptr left = erase(subtree->left, key, erased);
+		return erased ? balance(left, subtree->key_value_pair, subtree->right) : subtree;
+	}
+	if (cmp()(subtree->key_value_pair.first, key))
+	{
+		node_ptr right = erase(subtree->right, key, erased);
+		return erased ? balance(subtree->left, subtree->key_value_pair, right) : subtree;
+	}
+
+	erased = true;
+	if (!subtree->left)
+	{
+		return subtree->right;
+	}
+	if (!subtree->right)
+	{
+		return subtree->left;
+	}
+
+	const node* min = nullptr;
+	node_ptr right = erase_min(subtree->right, min);
+	return balance(subtree->left, min->key_value_pair, right);
+}
+
+// min is left pointing into the old subtree, which the caller still holds
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::node_ptr persistent_map<keyT, valueT, cmp>::erase_min(const node_ptr& subtree, const node*& min)
+{
+	if (!subtree->left)
+	{
+		min = subtree.get();
+		return subtree->right;
+	}
+	return balance(erase_min(subtree->left, min), subtree->key_value_pair, subtree->right);
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::iterator persistent_map<keyT, valueT, cmp>::begin() const
+{
+	iterator it;
+	it.m_root = load_root();
+
+	for (const node* current_node = it.m_root.get(); current_node; current_node = current_node->left.get())
+	{
+		it.m_path.push_back(current_node);
+	}
+	return it;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline typename persistent_map<keyT, valueT, cmp>::iterator persistent_map<keyT, valueT, cmp>::end() const
+{
+	return iterator();
+}
+
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::iterator persistent_map<keyT, valueT, cmp>::find(const keyT& key) const
+{
+	iterator it = lower_bound(key);
+	if (it.m_path.empty() || cmp()(key, it->first))
+	{
+		return end();
+	}
+	return it;
+}
+
+// The path keeps exactly the nodes where the search went left, so ++ carries
+// on from there as it would have from begin().
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::iterator persistent_map<keyT, valueT, cmp>::lower_bound(const keyT& key) const
+{
+	iterator it;
+	it.m_root = load_root();
+
+	const node* current_node = it.m_root.get();
+	while (current_node)
+	{
+		if (cmp()(current_node->key_value_pair.first, key))
+		{
+			current_node = current_node->right.get();
+		}
+		else
+		{
+			it.m_path.push_back(current_node);
+			current_node = current_node->left.get();
+		}
+	}
+
+	if (it.m_path.empty())
+	{
+		return end();
+	}
+	return it;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+template<typename visitor>
+inline void persistent_map<keyT, valueT, cmp>::for_each_in_range(const keyT& low, const keyT& high, visitor&& visit) const
+{
+	node_ptr version = load_root();
+	if (!cmp()(high, low))
+	{
+		visit_range(version.get(), low, high, visit);
+	}
+}
+
+template<typename keyT, typename valueT, typename cmp>
+template<typename visitor>
+void persistent_map<keyT, valueT, cmp>::visit_range(const node* subtree, const keyT& low, const keyT& high, visitor& visit)
+{
+	while (subtree)
+	{
+		if (cmp()(subtree->key_value_pair.first, low))
+		{
+			subtree = subtree->right.get();
+		}
+		else if (cmp()(high, subtree->key_value_pair.first))
+		{
+			subtree = subtree->left.get();
+		}
+		else
+		{
+			visit_range(subtree->left.get(), low, high, visit);
+			visit(subtree->key_value_pair);
+			subtree = subtree->right.get();
+		}
+	}
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline size_t persistent_map<keyT, valueT, cmp>::size() const
+{
+	return subtree_size(load_root());
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool persistent_map<keyT, valueT, cmp>::empty() const
+{
+	return size() == 0;
+}
+
+
+template<typename keyT, typename valueT, typename cmp>
+inline persistent_map<keyT, valueT, cmp>::iterator::iterator() {}
+
+template<typename keyT, typename valueT, typename cmp>
+inline typename persistent_map<keyT, valueT, cmp>::iterator::reference persistent_map<keyT, valueT, cmp>::iterator::operator*() const
+{
+	return m_path.back()->key_value_pair;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline typename persistent_map<keyT, valueT, cmp>::iterator::pointer persistent_map<keyT, valueT, cmp>::iterator::operator->() const
+{
+	return &m_path.back()->key_value_pair;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+typename persistent_map<keyT, valueT, cmp>::iterator& persistent_map<keyT, valueT, cmp>::iterator::operator++()
+{
+	const node* current_node = m_path.back();
+	m_path.pop_back();
+
+	for (current_node = current_node->right.get(); current_node; current_node = current_node->left.get())
+	{
+		m_path.push_back(current_node);
+	}
+
+	if (m_path.empty())
+	{
+		m_root.reset();
+	}
+	return *this;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline typename persistent_map<keyT, valueT, cmp>::iterator persistent_map<keyT, valueT, cmp>::iterator::operator++(int)
+{
+	iterator tmp = *this;
+	++(*this);
+	return tmp;
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool persistent_map<keyT, valueT, cmp>::iterator::operator==(const iterator& other) const
+{
+	return (m_path.empty() ? nullptr : m_path.back()) == (other.m_path.empty() ? nullptr : other.m_path.back());
+}
+
+template<typename keyT, typename valueT, typename cmp>
+inline bool persistent_map<keyT, valueT, cmp>::iterator::operator!=(const iterator& other) const
+{
+	return !(*this == other);
+}